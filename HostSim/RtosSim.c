@@ -0,0 +1,614 @@
+// RtosSim.c
+// Runs on Linux
+// Host simulation of a whole lab: the real os.c and the real task
+// code in Lab3.c or Lab4.c run on Linux, each main thread on its own
+// ucontext stack.  This file stands in for osasm.s, the board support
+// package and the TExaS grader.  Time is simulated in bus cycles
+// (80 MHz): the lab code is built with -fsanitize-coverage=trace-pc,
+// which calls back here at the start of every basic block, and each
+// block, BSP call and TExaS mark is charged a fixed cost.  A run is
+// then the same on every machine and every build, and can be checked
+// in CI.  SysTick, the periodic timers and the interrupts pended by
+// the OS are taken at those callbacks, whenever interrupts are enabled.
+// Build with LAB=3 for Lab3_4C123 or LAB=4 for Lab4_Fitness_4C123,
+// for example
+//   gcc -O1 -w -c -Dmain=LabMain -I../inc -fsanitize-coverage=trace-pc
+//       ../Lab3_4C123/Lab3.c ../Lab3_4C123/os.c
+//   gcc -O1 -no-pie -rdynamic -DLAB=3 -I../inc -o lab3sim RtosSim.c Lab3.o os.o
+//   ./lab3sim
+// With no arguments every main_step is run, each in a fresh process;
+// name some, like ./lab3sim step2 step4 main, to run only those.
+// For each it reports a hash of the schedule (which thread ran when),
+// the CPU time, dispatches and longest wait of each thread, and the
+// count, rate and period of each TExaS_Task mark.  What the lab
+// sends over UART0 is printed too, so Lab 4 step19 shows its kernel
+// benchmark; add -DFASTSEMA4=0 or another os.c option to the first
+// line to compare a variant.
+// The exclusive monitor is modelled too: LDREX in os.c sets it, every
+// interrupt taken clears it, and STREX, which runs here where no
+// interrupt can cut in, fails once it is clear.  So the default
+// FASTSEMA4=1 fast paths are exercised just as they run on the board.
+// -no-pie keeps the code below 4 GB, so the 32-bit PC os.c puts on
+// each initial stack finds the thread.
+// TicklessSim.c covers the TICKLESS kernel, this one the default.
+
+#define _GNU_SOURCE         // dladdr
+#include <dlfcn.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include "BSP.h"
+#include "CortexM.h"
+#include "UART0.h"
+#if LAB == 3
+#include "../Lab3_4C123/Texas.h"
+#define PCINDEX 14          // initial PC, from sp: R4-R11, R0-R3, R12, LR
+int main_step1(void); int main_step2(void); int main_step3(void);
+int main_step4(void); int main_step5(void);
+#elif LAB == 4
+#include "../Lab4_Fitness_4C123/Texas.h"
+#define PCINDEX 15          // initial PC, from sp: R4-R11, EXC_RETURN, R0-R3, R12, LR
+int main_step1(void); int main_step2(void); int main_step3(void);
+int main_step7(void); int main_step8(void); int main_step9(void);
+int main_step10(void); int main_step11(void); int main_step12(void);
+int main_step13(void); int main_step14(void); int main_step15(void);
+int main_step16(void); int main_step17(void); int main_step19(void);
+#else
+#error build with -DLAB=3 or -DLAB=4
+#endif
+int LabMain(void);          // the lab's main()
+extern void *RunPt;         // os.c, whatever its tcbType is, sp comes first
+void Scheduler(void);
+void SysTick_Handler(void);
+
+#define SIMSECONDS  10      // length of each run
+#define CYCLESPERUS 80      // 80 MHz bus clock
+#define SIMEND ((uint64_t)SIMSECONDS*1000000*CYCLESPERUS)
+
+// cost in bus cycles of what the simulated code does
+#define BLOCK       4       // a basic block of the lab code or os.c
+#define IOCALL      80      // a BSP sensor, button, LED or buzzer call
+#define LCDCALL     8000    // a BSP LCD call, 100 us over SPI
+#define UARTCHAR    6944    // a character at 115,200 bps
+#define MARK        40      // TExaS_Task0 ... TExaS_Task6
+#define PENDING     0x14000000 // PENDSTSET and PENDSVSET in INTCTRL
+
+//---------------- simulated processor ----------------
+uint64_t Now;               // bus cycles since reset
+uint64_t NextDue = SIMEND;  // next periodic interrupt, or the end of the run
+int IntsDisabled = 1;       // I bit in PRIMASK, set until StartOS
+int InHandler;              // an interrupt handler is running, they do not nest
+int Launched;               // StartOS has run the first thread
+
+//---------------- main threads ----------------
+#define MAXCONTEXTS 16
+#define SIMSTACK    65536   // bytes of host stack per thread
+struct context{
+  int32_t **tcb;            // its TCB, whose first field is sp
+  void (*thread)(void);     // the function os.c put on its stack
+  char name[32];
+  ucontext_t uc;
+  uint64_t cpu;             // cycles it ran, interrupts not included
+  uint64_t wfi;             // cycles it slept in WaitForInterrupt
+  uint32_t runs;            // times it was switched to
+  uint64_t lastOut;         // when it was last switched out
+  uint64_t maxGap;          // longest it went without running
+};
+struct context Contexts[MAXCONTEXTS];
+int NumContexts;
+struct context *Current;    // 0 before StartOS, while main() runs
+ucontext_t HostContext, BootContext;
+uint64_t HandlerCycles;         // cycles in interrupt handlers
+uint32_t Switches;          // context switches
+uint32_t ScheduleHash = 2166136261u; // FNV-1a of each switch, thread and time
+
+void threadentry(void){
+  Current->thread();
+  printf("  %s returned\n", Current->name);
+  setcontext(&HostContext);
+}
+// Finds the context of a TCB, making a new one the first time the
+// OS runs the thread.  Its PC word is cleared then, so a TCB given a
+// new thread by OS_AddThread is noticed.
+struct context *contextof(int32_t **tcb){
+  struct context *c;
+  int32_t *sp = *tcb;
+  for(c = Contexts; c < &Contexts[NumContexts]; c++){
+    if(c->tcb == tcb && sp[PCINDEX] == 0){
+      return c;
+    }
+  }
+  if(c == &Contexts[MAXCONTEXTS]){
+    printf("  more than %d threads\n", MAXCONTEXTS);
+    setcontext(&HostContext);
+  }
+  NumContexts++;
+  c->tcb = tcb;
+  c->thread = (void(*)(void))(uintptr_t)(uint32_t)sp[PCINDEX];
+  sp[PCINDEX] = 0;
+  Dl_info info;
+  if(dladdr((void *)c->thread, &info) && info.dli_saddr == (void *)c->thread){
+    snprintf(c->name, sizeof(c->name), "%s", info.dli_sname);
+  } else{
+    snprintf(c->name, sizeof(c->name), "kernel thread");
+  }
+  getcontext(&c->uc);
+  c->uc.uc_stack.ss_sp = malloc(SIMSTACK);
+  c->uc.uc_stack.ss_size = SIMSTACK;
+  c->uc.uc_link = 0;
+  makecontext(&c->uc, threadentry, 0);
+  c->lastOut = Now;
+  return c;
+}
+// switches to the thread RunPt points to, if it is not already running
+void dispatch(void){
+  struct context *from = Current;
+  struct context *to = contextof((int32_t **)RunPt);
+  if(to == from){
+    return;
+  }
+  Switches++;
+  ScheduleHash = (ScheduleHash^(uint32_t)(to-Contexts))*16777619u;
+  ScheduleHash = (ScheduleHash^(uint32_t)(Now/CYCLESPERUS))*16777619u;
+  to->runs++;
+  if(Now - to->lastOut > to->maxGap){
+    to->maxGap = Now - to->lastOut;
+  }
+  Current = to;
+  if(from){
+    from->lastOut = Now;
+    swapcontext(&from->uc, &to->uc);
+  } else{
+    swapcontext(&BootContext, &to->uc);
+  }
+}
+
+//---------------- interrupt sources ----------------
+struct source{
+  char *name;
+  void (*task)(void);       // interrupt handler, 0 if not in use
+  uint64_t period;          // cycles between interrupts
+  uint64_t next;            // time of the next interrupt
+  uint32_t count;           // interrupts taken
+};
+enum {SYSTICK, PERIODICA, PERIODICB, PERIODICC, NUMSOURCES};
+struct source Sources[NUMSOURCES] = {
+  {"SysTick"},
+  {"BSP_PeriodicTask_Init"},
+  {"BSP_PeriodicTask_InitB"},
+  {"BSP_PeriodicTask_InitC"}
+};
+#if LAB == 3
+void SysTick_Handler(void){ // osasm.s, the switch itself is done by dispatch
+  IntsDisabled = 1;
+  Scheduler();
+}
+#endif
+void PendSV_Handler(void){  // osasm.s
+  IntsDisabled = 1;
+  Scheduler();
+}
+void setnextdue(void){
+  NextDue = SIMEND;
+  for(int n=0; n<NUMSOURCES; n++){
+    if(Sources[n].task && Sources[n].next < NextDue){
+      NextDue = Sources[n].next;
+    }
+  }
+}
+void startsource(int n, void(*task)(void), uint32_t freq){
+  Sources[n].task = task;
+  Sources[n].period = (uint64_t)CYCLESPERUS*1000000/freq;
+  Sources[n].next = Now + Sources[n].period;
+  setnextdue();
+}
+// Picks up what the OS wrote to SysTick.  STCURRENT is left holding a
+// marker so a write to it, which restarts the count, is noticed.
+uint32_t LastSTCTRL;
+void synchardware(void){
+  int restart = 0;
+  if((STCTRL&1) && ((LastSTCTRL&1) == 0)){
+    restart = 1;             // just enabled
+  }
+  if(STCURRENT != 0xFFFFFFFF){
+    restart = 1;             // any write to current clears it
+    STCURRENT = 0xFFFFFFFF;
+  }
+  if(restart){
+    Sources[SYSTICK].period = STRELOAD+1;
+    Sources[SYSTICK].next = Now + Sources[SYSTICK].period;
+  }
+  LastSTCTRL = STCTRL;
+  Sources[SYSTICK].task = (STCTRL&1) ? &SysTick_Handler : 0;
+  setnextdue();
+}
+// LDREX sets ExclusiveMonitor and exception entry clears it, so a
+// STREX in os.c that a handler cut in on fails and is tried again
+uint32_t ExclusiveMonitor;
+int HostStrex(void *addr, uintptr_t value, uint32_t size){
+  if(ExclusiveMonitor == 0){
+    return 1;
+  }
+  if(size == sizeof(uint32_t)){
+    *(uint32_t *)addr = (uint32_t)value;
+  } else{
+    *(uintptr_t *)addr = value;
+  }
+  ExclusiveMonitor = 0;
+  return 0;
+}
+void runhandler(void (*handler)(void)){
+  int const sr = IntsDisabled;
+  ExclusiveMonitor = 0;
+  InHandler = 1;
+  handler();
+  IntsDisabled = sr;         // restored by the exception return
+  InHandler = 0;
+  synchardware();
+}
+// Takes the interrupts that are due or pended, if they are enabled,
+// then switches threads if the OS changed RunPt.
+void interrupts(void){
+  uint64_t const start = Now;
+  int taken;
+  if(IntsDisabled || InHandler || !Launched){
+    return;
+  }
+  if(Now >= SIMEND){
+    setcontext(&HostContext); // end of the run
+  }
+  do{
+    taken = 0;
+    for(int n=0; n<NUMSOURCES; n++){
+      if(Sources[n].task && Sources[n].next <= Now){
+        Sources[n].count++;
+        while(Sources[n].next <= Now){
+          Sources[n].next += Sources[n].period;
+        }
+        runhandler(Sources[n].task);
+        taken = 1;
+      }
+    }
+    if(INTCTRL&0x04000000){  // SysTick pended by the OS
+      INTCTRL &= ~0x04000000;
+      Sources[SYSTICK].count++;
+      runhandler(&SysTick_Handler);
+      taken = 1;
+    }
+    if(INTCTRL&0x10000000){  // PendSV, lowest priority, taken last
+      INTCTRL &= ~0x10000000;
+      runhandler(&PendSV_Handler);
+      taken = 1;
+    }
+  } while(taken);
+  HandlerCycles += Now - start;
+  dispatch();
+}
+// Charges cycles to the code running, taking the interrupts that
+// fall due on the way.  A thread preempted here finishes its cycles
+// when it next runs.
+void consume(uint32_t cycles){
+  while(Now + cycles >= NextDue && !IntsDisabled && !InHandler && Launched){
+    uint64_t const part = NextDue - Now;
+    if(Current){
+      Current->cpu += part;
+    }
+    cycles -= part;
+    Now = NextDue;
+    DWT_CYCCNT = (uint32_t)Now;
+    interrupts();
+  }
+  if(Current && !InHandler){
+    Current->cpu += cycles;
+  }
+  Now += cycles;
+  DWT_CYCCNT = (uint32_t)Now;
+  if(Now >= SIMEND && !Launched){
+    setcontext(&HostContext); // main() never started the OS
+  }
+}
+// every basic block of the lab code and os.c starts with this call
+void __sanitizer_cov_trace_pc(void){
+  consume(BLOCK);
+  if(STCURRENT != 0xFFFFFFFF || STCTRL != LastSTCTRL){
+    synchardware();          // the OS wrote SysTick
+  }
+  if(INTCTRL&PENDING){
+    interrupts();            // a PendSV or SysTick the OS pended
+  }
+}
+void DisableInterrupts(void){ IntsDisabled = 1; }
+void EnableInterrupts(void){
+  IntsDisabled = 0;
+  interrupts();
+}
+long StartCritical(void){
+  long const sr = IntsDisabled;
+  IntsDisabled = 1;
+  return sr;
+}
+void EndCritical(long sr){
+  IntsDisabled = (int)sr;
+  interrupts();
+}
+void WaitForInterrupt(void){
+  if(IntsDisabled || InHandler || !Launched){
+    return;
+  }
+  if(Current){
+    Current->wfi += NextDue - Now;
+  }
+  Now = NextDue;
+  DWT_CYCCNT = (uint32_t)Now;
+  interrupts();
+}
+void StartOS(void){
+  Launched = 1;
+  IntsDisabled = 0;
+  synchardware();
+  dispatch();                // never comes back to main()
+}
+
+//---------------- simulated BSP ----------------
+void BSP_Clock_InitFastest(void){}
+uint32_t BSP_Clock_GetFreq(void){ return CYCLESPERUS*1000000; }
+void BSP_PeriodicTask_Init(void(*task)(void), uint32_t freq, uint8_t priority){
+  startsource(PERIODICA, task, freq);
+}
+void BSP_PeriodicTask_InitB(void(*task)(void), uint32_t freq, uint8_t priority){
+  startsource(PERIODICB, task, freq);
+}
+void BSP_PeriodicTask_InitC(void(*task)(void), uint32_t freq, uint8_t priority){
+  startsource(PERIODICC, task, freq);
+}
+void BSP_Time_Init(void){}
+uint32_t BSP_Time_Get(void){ return (uint32_t)(Now/CYCLESPERUS); }
+void BSP_Delay1ms(uint32_t n){ consume(n*1000*CYCLESPERUS); }
+void BSP_Button1_Init(void){}
+uint8_t BSP_Button1_Input(void){ consume(IOCALL); return 1; } // never pressed
+void BSP_Button2_Init(void){}
+uint8_t BSP_Button2_Input(void){ consume(IOCALL); return 1; }
+void BSP_RGB_Init(uint16_t red, uint16_t green, uint16_t blue){}
+void BSP_RGB_Set(uint16_t red, uint16_t green, uint16_t blue){ consume(IOCALL); }
+void BSP_RGB_D_Init(int red, int green, int blue){}
+void BSP_RGB_D_Set(int red, int green, int blue){ consume(IOCALL); }
+void BSP_Buzzer_Init(uint16_t duty){}
+void BSP_Buzzer_Set(uint16_t duty){ consume(IOCALL); }
+// sensors read 512 plus the same noise on every run; a constant would
+// give sqrt32(0) in Lab3.c, which divides by zero
+uint32_t Noise = 1;
+uint16_t sample(void){
+  Noise = 1664525*Noise + 1013904223;
+  return 448 + (Noise>>25);  // 448 to 575
+}
+void BSP_Accelerometer_Init(void){}
+void BSP_Accelerometer_Input(uint16_t *x, uint16_t *y, uint16_t *z){
+  consume(IOCALL);
+  *x = sample(); *y = sample(); *z = sample();
+}
+void BSP_Microphone_Init(void){}
+void BSP_Microphone_Input(uint16_t *mic){ consume(IOCALL); *mic = sample(); }
+void BSP_LightSensor_Init(void){}
+void BSP_LightSensor_Start(void){ consume(IOCALL); }
+int BSP_LightSensor_End(uint32_t *light){ consume(IOCALL); *light = 10000; return 1; }
+void BSP_TempSensor_Init(void){}
+void BSP_TempSensor_Start(void){ consume(IOCALL); }
+int BSP_TempSensor_End(int32_t *sensorV, int32_t *localT){
+  consume(IOCALL);
+  *sensorV = 0; *localT = 25000;
+  return 1;
+}
+void BSP_LCD_Init(void){}
+uint16_t BSP_LCD_Color565(uint8_t r, uint8_t g, uint8_t b){
+  return ((b & 0xF8) << 8) | ((g & 0xFC) << 3) | (r >> 3);
+}
+void BSP_LCD_FillScreen(uint16_t color){ consume(LCDCALL); }
+void BSP_LCD_DrawBitmap(int16_t x, int16_t y, const uint16_t *image, int16_t w, int16_t h){ consume(LCDCALL); }
+uint32_t BSP_LCD_DrawString(uint16_t x, uint16_t y, char *pt, int16_t textColor){ consume(LCDCALL); return strlen(pt); }
+void BSP_LCD_SetCursor(uint32_t newX, uint32_t newY){}
+void BSP_LCD_OutUDec4(uint32_t n, int16_t textColor){ consume(LCDCALL); }
+void BSP_LCD_OutUFix2_1(uint32_t n, int16_t textColor){ consume(LCDCALL); }
+void BSP_LCD_Drawaxes(uint16_t axisColor, uint16_t bgColor, char *xLabel,
+  char *yLabel1, uint16_t label1Color, char *yLabel2, uint16_t label2Color,
+  int32_t ymax, int32_t ymin){ consume(LCDCALL); }
+void BSP_LCD_PlotPoint(int32_t data1, uint16_t color1){ consume(LCDCALL); }
+void BSP_LCD_PlotIncrement(void){ consume(LCDCALL); }
+void Profile_Init(void){}
+void UART0_Init(void){}
+// what the lab sends to the terminal is printed, without the \r
+void UART0_OutChar(char data){
+  consume(UARTCHAR);
+  if(data != '\r'){
+    putchar(data);
+  }
+}
+void UART0_OutString(char *pt){
+  while(*pt){
+    UART0_OutChar(*pt++);
+  }
+}
+void UART0_OutUDec(uint32_t n){
+  if(n >= 10){
+    UART0_OutUDec(n/10);
+  }
+  UART0_OutChar('0' + n%10);
+}
+
+//---------------- simulated TExaS grader ----------------
+// The grader times each TExaS_Task mark, so the same is done here.
+#define NUMMARKS 7
+struct mark{
+  uint32_t count;
+  uint64_t last;            // time of the previous mark
+  uint64_t minPeriod, maxPeriod, sumPeriod;
+};
+struct mark Marks[NUMMARKS];
+void TExaS_Init(enum TExaSmode mode, uint32_t edXcode){}
+void mark(int n){
+  struct mark *m = &Marks[n];
+  consume(MARK);
+  if(m->count){
+    uint64_t const period = Now - m->last;
+    if(m->count == 1 || period < m->minPeriod){
+      m->minPeriod = period;
+    }
+    if(period > m->maxPeriod){
+      m->maxPeriod = period;
+    }
+    m->sumPeriod += period;
+  }
+  m->count++;
+  m->last = Now;
+}
+void TExaS_Task0(void){ mark(0); }
+void TExaS_Task1(void){ mark(1); }
+void TExaS_Task2(void){ mark(2); }
+void TExaS_Task3(void){ mark(3); }
+void TExaS_Task4(void){ mark(4); }
+void TExaS_Task5(void){ mark(5); }
+void TExaS_Task6(void){ mark(6); }
+
+//---------------- runs ----------------
+struct program{
+  char *name;
+  int (*main)(void);
+};
+struct program Programs[] = {
+#if LAB == 3
+  {"step1", main_step1}, {"step2", main_step2}, {"step3", main_step3},
+  {"step4", main_step4}, {"step5", main_step5},
+#else
+  {"step1", main_step1}, {"step2", main_step2}, {"step3", main_step3},
+  {"step7", main_step7}, {"step8", main_step8}, {"step9", main_step9},
+  {"step10", main_step10}, {"step11", main_step11}, {"step12", main_step12},
+  {"step13", main_step13}, {"step14", main_step14}, {"step15", main_step15},
+  {"step16", main_step16}, {"step17", main_step17}, {"step19", main_step19},
+#endif
+  {"main", LabMain}
+};
+#define NUMPROGRAMS (sizeof(Programs)/sizeof(Programs[0]))
+struct program *Running;
+
+void boot(void){
+  Running->main();
+  printf("  main returned\n");
+  setcontext(&HostContext);
+}
+double percent(uint64_t cycles){
+  return 100.0*cycles/Now;
+}
+double ms(uint64_t cycles){
+  return (double)cycles/(CYCLESPERUS*1000);
+}
+double seconds(uint64_t cycles){
+  return (double)cycles/(CYCLESPERUS*1000000);
+}
+double us(uint64_t cycles){
+  return (double)cycles/CYCLESPERUS;
+}
+void report(void){
+  uint64_t wfi = 0;
+  printf("Lab %d %s, %.3f s simulated\n", LAB, Running->name, seconds(Now));
+  if(Launched && (IntsDisabled || InHandler)){
+    printf("  ended with interrupts disabled%s\n", InHandler ? ", in an interrupt handler" : "");
+  }
+  printf("  schedule %08X, %u context switches\n", ScheduleHash, Switches);
+  printf("  %-16s %7s %8s %13s\n", "thread", "CPU", "runs", "max wait(ms)");
+  for(struct context *c = Contexts; c < &Contexts[NumContexts]; c++){
+    printf("  %-16s %6.2f%% %8u %13.3f\n", c->name, percent(c->cpu), c->runs, ms(c->maxGap));
+    wfi += c->wfi;
+  }
+  printf("  %-16s %6.2f%%\n", "interrupts", percent(HandlerCycles));
+  printf("  %-16s %6.2f%%\n", "WaitForInterrupt", percent(wfi));
+  for(int n=0; n<NUMSOURCES; n++){
+    if(Sources[n].count){
+      printf("  %-23s %8u interrupts\n", Sources[n].name, Sources[n].count);
+    }
+  }
+  for(int n=0; n<NUMMARKS; n++){
+    struct mark *m = &Marks[n];
+    if(m->count > 1){
+      printf("  TExaS_Task%d %8u marks %9.1f/s, period min %.1f avg %.1f max %.1f us\n",
+             n, m->count, m->count/seconds(Now), us(m->minPeriod),
+             us(m->sumPeriod)/(m->count-1), us(m->maxPeriod));
+    }
+  }
+}
+// A run that faults stops here, where the board would be in a fault
+// handler.  The Cortex-M gives 0 for a divide by zero, Linux stops.
+void stopped(int sig){
+  printf("Lab %d %s %s at %.6f s simulated\n", LAB, Running->name,
+         (sig == SIGFPE) ? "divided by zero" : "hard fault",
+         seconds(Now));
+  fflush(stdout);
+  _exit(1);
+}
+// Every second of real time, checks that simulated time has moved.
+// It stops at a loop with no basic blocks to count, like the
+// while(1){} a benchmark step ends in, and that run is reported there.
+uint64_t LastNow = ~0ULL;
+void watchdog(int sig){
+  if(Now == LastNow){
+    printf("Lab %d %s parked in a loop at %.6f s simulated\n", LAB, Running->name,
+           seconds(Now));
+    report();
+    fflush(stdout);
+    _exit(0);
+  }
+  LastNow = Now;
+  alarm(1);
+}
+void run(struct program *program){
+  static char bootStack[SIMSTACK];
+  Running = program;
+  signal(SIGSEGV, stopped);
+  signal(SIGFPE, stopped);
+  signal(SIGALRM, watchdog);
+  alarm(1);
+  getcontext(&BootContext);
+  BootContext.uc_stack.ss_sp = bootStack;
+  BootContext.uc_stack.ss_size = sizeof(bootStack);
+  BootContext.uc_link = 0;
+  makecontext(&BootContext, boot, 0);
+  swapcontext(&HostContext, &BootContext);
+  report();
+}
+
+int main(int argc, char **argv){
+  // peripherals and the private peripheral bus live where os.c expects them
+  if(mmap((void *)0x40000000, 0x100000, PROT_READ|PROT_WRITE,
+          MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED, -1, 0) == MAP_FAILED ||
+     mmap((void *)0xE0000000, 0x100000, PROT_READ|PROT_WRITE,
+          MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED, -1, 0) == MAP_FAILED){
+    perror("mmap");
+    return 1;
+  }
+  memset((void *)0x400FE000, 0xFF, 0x1000); // every peripheral is ready at once
+  STCURRENT = 0xFFFFFFFF;
+  setvbuf(stdout, 0, _IOLBF, 0);
+  for(int i=0; i<(int)NUMPROGRAMS; i++){
+    int chosen = (argc == 1);
+    for(int j=1; j<argc; j++){
+      chosen |= (strcmp(argv[j], Programs[i].name) == 0);
+    }
+    if(chosen){
+      // each runs in its own process, so it starts from reset
+      if(fork() == 0){
+        run(&Programs[i]);
+        return 0;
+      }
+      int status;
+      wait(&status);
+      if(WIFSIGNALED(status)){
+        printf("Lab %d %s killed by signal %d\n", LAB, Programs[i].name, WTERMSIG(status));
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,427 @@
+// TicklessSim.c
+// Runs on Linux
+// Host simulation of the Lab 4 kernel timers.  The real
+// Lab4_Fitness_4C123/os.c is compiled in, the Cortex-M and TM4C123
+// register space is mapped at its real addresses, and scripted threads
+// stand in for the Lab 4 tasks.  Time only moves forward in simulated
+// microseconds, so the results are the same on every run.
+// Build once with TICKLESS=0 and once with TICKLESS=1 to compare the
+// interrupt counts and idle time of the two kernel modes:
+//   gcc -O2 -DTICKLESS=0 -I../inc -o ticksim TicklessSim.c && ./ticksim
+//   gcc -O2 -DTICKLESS=1 -I../inc -o ticklesssim TicklessSim.c && ./ticklesssim
+// Build with EDF=0 and EDF=1 to compare the deadlines missed by the
+// periodic task sets under fixed priority and earliest deadline first:
+//   gcc -O2 -DEDF=0 -I../inc -o fpsim TicklessSim.c && ./fpsim
+//   gcc -O2 -DEDF=1 -I../inc -o edfsim TicklessSim.c && ./edfsim
+// Build with TRACE=1 to also write the first TRACETIME of the fitness
+// task set to trace.bin, in the form OS_TraceDrain sends over UART0,
+// for TraceJson.c to turn into a timeline:
+//   gcc -O2 -DTRACE=1 -I../inc -o tracesim TicklessSim.c && ./tracesim
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// os.c stores 32-bit addresses in 32-bit stack words
+#pragma GCC diagnostic ignored "-Wint-to-pointer-cast"
+#pragma GCC diagnostic ignored "-Wpointer-to-int-cast"
+#include "../Lab4_Fitness_4C123/os.c"
+
+#define SIMTIME   10000000  // length of each run in us
+#define CYCLESPERUS 80      // 80 MHz bus clock
+#define TRACETIME 100000    // us of the fitness task set traced with TRACE 1
+
+//---------------- simulated processor ----------------
+uint64_t Now;               // simulated time in us
+// Handlers only run between script steps here, never inside a
+// LDREX/STREX pair, but each still clears the monitor like the CPU
+uint32_t ExclusiveMonitor;
+int HostStrex(void *addr, uintptr_t value, uint32_t size){
+  if(ExclusiveMonitor == 0){
+    return 1;
+  }
+  if(size == sizeof(uint32_t)){
+    *(uint32_t *)addr = (uint32_t)value;
+  } else{
+    *(uintptr_t *)addr = value;
+  }
+  ExclusiveMonitor = 0;
+  return 0;
+}
+int IntsDisabled;           // simulated I bit in PRIMASK
+void DisableInterrupts(void){ IntsDisabled = 1; }
+void EnableInterrupts(void){ IntsDisabled = 0; }
+long StartCritical(void){ long sr = IntsDisabled; IntsDisabled = 1; return sr; }
+void EndCritical(long sr){ IntsDisabled = (int)sr; }
+void WaitForInterrupt(void){} // the event loop runs the idle thread
+void StartOS(void){}          // the event loop runs RunPt from here on
+
+//---------------- simulated BSP ----------------
+struct source{
+  char *name;
+  void (*task)(void);       // interrupt handler, 0 if not in use
+  uint64_t period;          // us between interrupts, 0 for one-shot
+  uint64_t next;            // time of the next interrupt
+  uint32_t count;           // interrupts taken
+};
+enum {SYSTICK, SLEEPSWEEP, REALTIME, ONESHOT, NUMSOURCES};
+struct source Sources[NUMSOURCES] = {
+  {"SysTick time slice"},
+  {"Wide Timer5A sleep sweep"},
+  {"Wide Timer3A RealTimeEvents"},
+  {"Wide Timer2A one-shot"}
+};
+#if TRACE
+// exception numbers, for VECTACTIVE in INTCTRL
+uint32_t Vectors[NUMSOURCES] = {15, INT_WTIMER5A, INT_WTIMER3A, INT_WTIMER2A};
+FILE *TraceFile;            // UART0 output, 0 if not tracing
+void UART0_OutChar(char data){
+  if(TraceFile){
+    putc(data, TraceFile);
+  }
+}
+#endif
+uint32_t SchedulerRuns;     // PendSV handler runs
+uint32_t IdleWakeups;       // interrupts that ended a WFI
+uint64_t IdleTime;          // us spent in the idle thread
+
+void BSP_Clock_InitFastest(void){}
+uint32_t BSP_Clock_GetFreq(void){ return CYCLESPERUS*1000000; }
+void BSP_Time_Init(void){}
+uint32_t BSP_Time_Get(void){ return (uint32_t)Now; }
+void static startsource(int n, void(*task)(void), uint32_t freq){
+  Sources[n].task = task;
+  Sources[n].period = 1000000/freq;
+  Sources[n].next = Now + Sources[n].period;
+}
+void BSP_PeriodicTask_Init(void(*task)(void), uint32_t freq, uint8_t priority){
+  startsource(SLEEPSWEEP, task, freq);
+}
+void BSP_PeriodicTask_InitC(void(*task)(void), uint32_t freq, uint8_t priority){
+  startsource(REALTIME, task, freq);
+}
+void pendsvhandler(void){
+  SchedulerRuns++;
+  Scheduler();
+}
+
+// Picks up what the kernel wrote to SysTick and Wide Timer2A.
+// The simulator leaves markers in STCURRENT and WTIMER2_TAILR_R
+// so it can tell when the kernel has written them.
+uint32_t LastSTCTRL;
+void synchardware(void){
+  int restart = 0;
+  if((STCTRL&1) && ((LastSTCTRL&1) == 0)){
+    restart = 1;             // just enabled
+  }
+  if(STCURRENT != 0xFFFFFFFF){
+    restart = 1;             // any write to current clears it
+    STCURRENT = 0xFFFFFFFF;
+  }
+  if(restart){
+    Sources[SYSTICK].period = (STRELOAD+1)/CYCLESPERUS;
+    Sources[SYSTICK].next = Now + Sources[SYSTICK].period;
+  }
+  LastSTCTRL = STCTRL;
+  Sources[SYSTICK].task = (STCTRL&1) ? &SysTick_Handler : 0;
+#if TICKLESS
+  if((WTIMER2_CTL_R&TIMER_CTL_TAEN) == 0){
+    Sources[ONESHOT].task = 0;
+  } else if(WTIMER2_TAILR_R){
+    Sources[ONESHOT].task = &WideTimer2A_Handler;
+    Sources[ONESHOT].next = Now + WTIMER2_TAILR_R + 1;
+    WTIMER2_TAILR_R = 0;
+  }
+#endif
+}
+// runs a triggered PendSV once interrupts are enabled
+void takependingpendsv(void){
+  if((INTCTRL&0x10000000) && (IntsDisabled == 0)){
+    INTCTRL &= ~0x10000000;
+    ExclusiveMonitor = 0;
+    pendsvhandler();
+    synchardware();
+  }
+}
+uint64_t nexthardwareevent(void){
+  uint64_t next = SIMTIME;
+  for(int n=0; n<NUMSOURCES; n++){
+    if(Sources[n].task && Sources[n].next < next){
+      next = Sources[n].next;
+    }
+  }
+  return next;
+}
+void firehardware(int idle){
+  for(int n=0; n<NUMSOURCES; n++){
+    if(Sources[n].task && Sources[n].next <= Now){
+      void (*task)(void) = Sources[n].task;
+      Sources[n].count++;
+      IdleWakeups += idle;
+      idle = 0;
+      if(Sources[n].period){
+        Sources[n].next += Sources[n].period;
+      } else{
+        Sources[n].task = 0;  // one-shot done
+        WTIMER2_CTL_R &= ~TIMER_CTL_TAEN;
+      }
+      DWT_CYCCNT = (uint32_t)(Now*CYCLESPERUS);
+      ExclusiveMonitor = 0;
+#if TRACE
+      INTCTRL = (INTCTRL&~0x1FF)|Vectors[n];
+      (*task)();
+      INTCTRL &= ~0x1FF;
+#else
+      (*task)();
+#endif
+      synchardware();
+    }
+  }
+  takependingpendsv();
+}
+
+//---------------- scripted threads ----------------
+enum op{COMPUTE, SLEEP, PERIODIC, WAIT, TIMEDWAIT, SIGNAL, SIGNALEVERY, FIFOPUT, FIFOGET};
+struct action{
+  enum op op;
+  uint32_t arg;             // us for COMPUTE, ms for SLEEP, PERIODIC and TIMEDWAIT, count for SIGNALEVERY
+  Sema4Type *sema;
+};
+#define MAXACTIONS 4
+struct script{
+  uint32_t priority;
+  struct action actions[MAXACTIONS]; // repeats forever, ends at first zero COMPUTE
+  uint32_t period;          // ms, for OS_SetDeadline, 0 if it has no deadline
+  uint32_t deadline;        // ms, 0 for the period
+  uint32_t wcet;            // us it declares, jobs may run longer
+};
+struct threadstate{
+  struct script *script;
+  int pc;                   // next action
+  uint32_t left;            // us left in the current COMPUTE
+  uint32_t count;           // calls of the current SIGNALEVERY
+  uint32_t release;         // OSTime of the next PERIODIC release
+};
+struct threadstate Threads[NUMTHREADS];
+
+void step(struct threadstate *t, uint64_t next){
+  struct action *a = &t->script->actions[t->pc];
+  int done = 1;
+  DWT_CYCCNT = (uint32_t)(Now*CYCLESPERUS);
+  switch(a->op){
+    case COMPUTE:
+      if(t->left == 0){
+        t->left = a->arg;
+      }
+      if(Now + t->left <= next){
+        Now = Now + t->left;
+        t->left = 0;
+      } else{
+        t->left -= (uint32_t)(next - Now);
+        Now = next;
+        done = 0;             // preempted by hardware
+      }
+      break;
+    case SLEEP:       OS_Sleep(a->arg); break;
+    case PERIODIC:
+      t->release += a->arg;
+      OS_SleepUntil(t->release);
+      break;
+    case WAIT:        OS_Wait(a->sema); break;
+    case TIMEDWAIT:   OS_WaitTimeout(a->sema, a->arg); break;
+    case SIGNAL:      OS_Signal(a->sema); break;
+    case SIGNALEVERY:
+      t->count++;
+      if(t->count == a->arg){
+        t->count = 0;
+        OS_Signal(a->sema);
+      }
+      break;
+    case FIFOPUT:     OS_FIFO_Put(Now); break;
+    case FIFOGET:     OS_FIFO_Get(); break;
+  }
+  if(done){
+    t->pc++;
+    if(t->pc == MAXACTIONS || (t->script->actions[t->pc].op == COMPUTE &&
+                               t->script->actions[t->pc].arg == 0)){
+      t->pc = 0;
+    }
+  }
+}
+
+void run(char *name, struct script *scripts, int numScripts,
+         Sema4Type *trigger0, uint32_t period0, Sema4Type *trigger1, uint32_t period1){
+  OS_Init();
+  OS_FIFO_Init();
+  for(int i=0; i<numScripts; i++){
+    OS_AddThread((void(*)(void))0, scripts[i].priority, STACKMIN);
+    Threads[i].script = &scripts[i];
+    if(scripts[i].period &&
+       OS_SetDeadline(i, scripts[i].period, scripts[i].deadline, scripts[i].wcet) == 0){
+      printf("  thread %d not admitted\n", i);
+    }
+  }
+  if(trigger0){
+    OS_PeriodTrigger0_Init(trigger0, period0);
+  }
+  if(trigger1){
+    OS_PeriodTrigger1_Init(trigger1, period1);
+  }
+  OS_Launch(CYCLESPERUS*1000); // 1 ms time slice
+  EnableInterrupts();
+  synchardware();
+#if TRACE
+  if(TraceFile){
+    OS_TraceStart(TRACE_ALL);
+  }
+#endif
+  while(Now < SIMTIME){
+#if TRACE
+    if(TraceFile){
+      OS_TraceDrain();        // the UART is as fast as it needs to be
+      if(Now >= TRACETIME){
+        fclose(TraceFile);
+        TraceFile = 0;
+      }
+    }
+#endif
+    uint64_t next = nexthardwareevent();
+    if(RunPt == &tcbs[IDLETHREAD]){
+      IdleTime += next - Now;  // WFI until the next interrupt
+      Now = next;
+      firehardware(1);
+    } else{
+      step(&Threads[RunPt - tcbs], next);
+      synchardware();
+      if(Now >= next){
+        firehardware(0);
+      }
+      takependingpendsv();
+    }
+  }
+  uint32_t total = 0;
+  printf("%s, TICKLESS=%d, EDF=%d, %d s simulated\n", name, TICKLESS, EDF, SIMTIME/1000000);
+  for(int n=0; n<NUMSOURCES; n++){
+    if(Sources[n].count){
+      printf("  %-28s %8u interrupts\n", Sources[n].name, Sources[n].count);
+      total += Sources[n].count;
+    }
+  }
+  printf("  %-28s %8u interrupts\n", "total timer", total);
+  printf("  %-28s %8u\n", "scheduler runs", SchedulerRuns);
+  printf("  %-28s %8u\n", "wakeups from WFI", IdleWakeups);
+  printf("  %-28s %8.2f %%\n", "idle", 100.0*IdleTime/SIMTIME);
+  for(int i=0; i<numScripts; i++){
+    DeadlineStatsType d;
+    if(OS_GetDeadlines(i, &d) && (d.jobs || d.misses)){
+      printf("  thread %d periodic jobs %8u, %u missed, worst lateness %d us\n",
+             i, d.jobs, d.misses, d.worstLateness);
+    }
+  }
+}
+
+//---------------- workloads ----------------
+// Lab 4 fitness device without the Task7 dummy, times in us of computation
+Sema4Type TakeSoundData, TakeAccelerationData, NewData, SwitchTouch;
+struct script Fitness[] = {
+  {0, {{WAIT, 0, &TakeSoundData}, {COMPUTE, 15}, {SIGNALEVERY, 1000, &NewData}}}, // Task0 microphone
+  {1, {{WAIT, 0, &TakeAccelerationData}, {COMPUTE, 60}, {FIFOPUT}}},              // Task1 accelerometer
+  {2, {{FIFOGET}, {COMPUTE, 1500}}},                                            // Task2 plot on LCD
+  {3, {{WAIT, 0, &SwitchTouch}, {COMPUTE, 100}}},                               // Task3 button, never touched
+  {3, {{COMPUTE, 20}, {SLEEP, 1000}, {COMPUTE, 20}}},                           // Task4 temperature
+  {3, {{WAIT, 0, &NewData}, {COMPUTE, 6000}}},                                  // Task5 numbers on LCD
+  {3, {{COMPUTE, 300}, {SLEEP, 800}, {COMPUTE, 300}}},                          // Task6 light
+};
+// Lab 4 Step 1 producers and consumers without the TaskG/TaskH dummies
+Sema4Type sAB, sCD, sEF;
+struct script Sleepers[] = {
+  {0, {{COMPUTE, 10}, {SIGNAL, 0, &sAB}, {SLEEP, 20}}},  // TaskA
+  {1, {{WAIT, 0, &sAB}, {COMPUTE, 50}}},                 // TaskB
+  {2, {{COMPUTE, 10}, {SIGNAL, 0, &sCD}, {SLEEP, 50}}},  // TaskC
+  {3, {{WAIT, 0, &sCD}, {COMPUTE, 50}}},                 // TaskD
+  {4, {{COMPUTE, 10}, {SIGNAL, 0, &sEF}, {SLEEP, 100}}}, // TaskE
+  {5, {{WAIT, 0, &sEF}, {COMPUTE, 50}}},                 // TaskF
+};
+// Periodic Lab 4 threads at their Lab 4 priorities, with the
+// computation scaled up so they need 90% of the CPU.  Task1's 20 ms
+// job at priority 1 holds up Task3, due every 10 ms, so fixed
+// priority misses deadlines that EDF, with the same load, meets.
+struct script Periodic[] = {
+  {0, {{COMPUTE, 300}, {PERIODIC, 1}}, 1, 0, 300},                // Task0 microphone
+  {1, {{COMPUTE, 20000}, {PERIODIC, 100}}, 100, 0, 20000},        // Task1 accelerometer
+  {3, {{COMPUTE, 2000}, {PERIODIC, 10}}, 10, 0, 2000},            // Task3 button
+  {3, {{COMPUTE, 100000}, {PERIODIC, 1000}}, 1000, 0, 100000},    // Task4 temperature
+  {3, {{COMPUTE, 80000}, {PERIODIC, 800}}, 800, 0, 80000},        // Task6 light
+};
+// The same threads in overload: Task4 and Task6 run well past the
+// wcet they were admitted with, so the CPU would need to be 115% busy
+struct script Overload[] = {
+  {0, {{COMPUTE, 300}, {PERIODIC, 1}}, 1, 0, 300},                // Task0 microphone
+  {1, {{COMPUTE, 20000}, {PERIODIC, 100}}, 100, 0, 20000},        // Task1 accelerometer
+  {3, {{COMPUTE, 2000}, {PERIODIC, 10}}, 10, 0, 2000},            // Task3 button
+  {3, {{COMPUTE, 250000}, {PERIODIC, 1000}}, 1000, 0, 100000},    // Task4 temperature
+  {3, {{COMPUTE, 160000}, {PERIODIC, 800}}, 800, 0, 80000},       // Task6 light
+};
+
+// Lab 4 Step 17 with its producer stalled: the reporter waits 250 ms
+// at a time on a semaphore no one signals, while Task6 carries on.
+// The timed waiter is in SleepList, so it costs one wakeup per
+// timeout, with no polling in between.
+Sema4Type sStalled;
+struct script Stalled[] = {
+  {2, {{TIMEDWAIT, 250, &sStalled}, {COMPUTE, 50}}},                 // Reporter
+  {3, {{COMPUTE, 300}, {SLEEP, 800}, {COMPUTE, 300}}},                // Task6 light
+};
+
+int main(void){
+  // peripherals and the private peripheral bus live where os.c expects them
+  if(mmap((void *)0x40000000, 0x100000, PROT_READ|PROT_WRITE,
+          MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED, -1, 0) == MAP_FAILED ||
+     mmap((void *)0xE0000000, 0x100000, PROT_READ|PROT_WRITE,
+          MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED, -1, 0) == MAP_FAILED){
+    perror("mmap");
+    return 1;
+  }
+  SYSCTL_PRWTIMER_R = 0xFFFFFFFF; // every peripheral is ready at once
+  SYSCTL_PRGPIO_R = 0xFFFFFFFF;
+  STCURRENT = 0xFFFFFFFF;
+  // each workload runs in its own process, so it starts from a fresh kernel
+  if(fork() == 0){
+#if TRACE
+    TraceFile = fopen("trace.bin", "wb");
+#endif
+    run("Lab 4 fitness task set", Fitness, sizeof(Fitness)/sizeof(Fitness[0]),
+        &TakeSoundData, 1, &TakeAccelerationData, 100);
+    return 0;
+  }
+  wait(0);
+  if(fork() == 0){
+    run("Lab 4 sleeping producers", Sleepers, sizeof(Sleepers)/sizeof(Sleepers[0]),
+        0, 0, 0, 0);
+    return 0;
+  }
+  wait(0);
+  if(fork() == 0){
+    run("Lab 4 periodic threads, 90% load", Periodic, sizeof(Periodic)/sizeof(Periodic[0]),
+        0, 0, 0, 0);
+    return 0;
+  }
+  wait(0);
+  if(fork() == 0){
+    run("Lab 4 periodic threads, 115% load", Overload, sizeof(Overload)/sizeof(Overload[0]),
+        0, 0, 0, 0);
+    return 0;
+  }
+  wait(0);
+  if(fork() == 0){
+    OS_InitSemaphore(&sStalled, 0);
+    run("Lab 4 stalled producer", Stalled, sizeof(Stalled)/sizeof(Stalled[0]),
+        0, 0, 0, 0);
+    return 0;
+  }
+  wait(0);
+  return 0;
+}
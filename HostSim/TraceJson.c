@@ -0,0 +1,224 @@
+// TraceJson.c
+// Runs on Linux
+// Turns an event trace sent by OS_TraceDrain (Lab4_Fitness_4C123/os.c
+// built with TRACE 1) into the Chrome trace event JSON format, which
+// ui.perfetto.dev and chrome://tracing show as a timeline: one track
+// per thread showing when it ran, one track for the OS interrupt
+// handlers, and marks for each wait, signal, wakeup, periodic
+// release and lost event.
+// Capture UART0 to a file, for example on Linux
+//   stty -F /dev/ttyACM0 115200 raw && cat /dev/ttyACM0 > capture.bin
+// then
+//   gcc -O2 -o tracejson TraceJson.c
+//   ./tracejson capture.bin > trace.json
+// Times are converted with the bus clock in the TRACE_START event,
+// or with --mhz if the capture started after it.
+// TicklessSim.c built with -DTRACE=1 writes a capture to trace.bin.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// must match Lab4_Fitness_4C123/os.h
+#define TRACE_START    0
+#define TRACE_SWITCH   1
+#define TRACE_WAIT     2
+#define TRACE_SIGNAL   3
+#define TRACE_WAKE     4
+#define TRACE_ISRENTER 5
+#define TRACE_ISREXIT  6
+#define TRACE_RELEASE  7
+#define TRACE_LOST     8
+// must match Lab4_Fitness_4C123/os.c
+#define TRACESYNC   0xA5
+#define TRACEISR    0xFF
+#define RECORDSIZE  9
+
+#define ISRTRACK    TRACEISR // tid of the interrupt track, never a thread
+#define MAXTRACKS   256
+#define MAXNESTING  8       // interrupt handlers open at once
+
+uint32_t MHz;               // bus clock, 0 until known
+int MHzFixed;               // set by --mhz, TRACE_START does not change it
+uint32_t NumThreads = 8;    // NUMTHREADS, from TRACE_START
+int Started;                // first event seen
+uint32_t LastCycles;        // cycles of the previous event
+uint64_t Cycles;            // cycles since the first event, unwrapped
+int Running = -1;           // thread with an open slice, -1 if none
+int Named[MAXTRACKS];       // thread_name written for this track
+char Handlers[MAXNESTING][16]; // names of the open handler slices
+int Nesting;                // open handler slices
+uint32_t Events, Skipped, Lost;
+int First = 1;              // no JSON event written yet
+
+double us(void){
+  return (double)Cycles/(MHz ? MHz : 80);
+}
+void comma(void){
+  if(First){
+    First = 0;
+  } else{
+    printf(",\n");
+  }
+}
+void nametrack(int tid){
+  if(Named[tid]){
+    return;
+  }
+  comma();
+  printf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"", tid);
+  if(tid == ISRTRACK){
+    printf("interrupts");
+  } else if(tid == (int)NumThreads){
+    printf("idle");
+  } else if(tid == (int)NumThreads+1){
+    printf("work queue");
+  } else{
+    printf("thread %d", tid);
+  }
+  printf("\"}}");
+  Named[tid] = 1;
+}
+// Cortex-M exception number to a name, 16 and up are IRQs
+void vectorname(char *name, uint32_t vector){
+  switch(vector){
+    case 11: strcpy(name, "SVCall"); break;
+    case 14: strcpy(name, "PendSV"); break;
+    case 15: strcpy(name, "SysTick"); break;
+    default:
+      if(vector >= 16){
+        sprintf(name, "IRQ %u", vector-16);
+      } else{
+        sprintf(name, "exception %u", vector);
+      }
+  }
+}
+void slice(char ph, int tid, char *name){
+  nametrack(tid);
+  comma();
+  printf("{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":1,\"tid\":%d,\"ts\":%.3f}",
+         name, ph, tid, us());
+}
+void instant(int tid, char *name, uint32_t arg){
+  nametrack(tid);
+  comma();
+  printf("{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,"
+         "\"args\":{\"arg\":%u}}", name, tid, us(), arg);
+}
+// thread field of a wait or signal, the interrupt track if from an ISR
+int eventtrack(uint32_t thread){
+  return (thread == TRACEISR) ? ISRTRACK : (int)thread;
+}
+
+void event(uint8_t *r){
+  uint32_t type = r[1];
+  uint32_t thread = r[2];
+  uint32_t arg = r[3] | (r[4] << 8);
+  uint32_t cycles = r[5] | (r[6] << 8) | (r[7] << 16) | ((uint32_t)r[8] << 24);
+  char name[32];
+
+  if(Started){
+    Cycles += (uint32_t)(cycles - LastCycles); // DWT_CYCCNT wraps every 53 s at 80 MHz
+  }
+  Started = 1;
+  LastCycles = cycles;
+  Events++;
+  switch(type){
+    case TRACE_START:
+      if(!MHzFixed){
+        MHz = arg;
+      }
+      NumThreads = thread;
+      break;
+    case TRACE_SWITCH:
+      if(Running >= 0){
+        slice('E', Running, "running");
+      }
+      Running = thread;
+      slice('B', Running, "running");
+      break;
+    case TRACE_WAIT:
+      sprintf(name, "wait %04X", arg);
+      instant(eventtrack(thread), name, arg);
+      break;
+    case TRACE_SIGNAL:
+      sprintf(name, "signal %04X", arg);
+      instant(eventtrack(thread), name, arg);
+      break;
+    case TRACE_WAKE:
+      instant(thread, "wake", 0);
+      break;
+    case TRACE_ISRENTER:
+      if(Nesting < MAXNESTING){
+        vectorname(Handlers[Nesting], arg);
+        slice('B', ISRTRACK, Handlers[Nesting]);
+        Nesting++;
+      }
+      break;
+    case TRACE_ISREXIT:
+      if(Nesting > 0){       // named after its entry, which began the slice
+        Nesting--;
+        slice('E', ISRTRACK, Handlers[Nesting]);
+      }
+      break;
+    case TRACE_RELEASE:
+      sprintf(name, "release trigger %u", arg);
+      instant(eventtrack(thread), name, arg);
+      break;
+    case TRACE_LOST:
+      Lost += arg;
+      instant(ISRTRACK, "events lost", arg);
+      break;
+  }
+}
+
+int main(int argc, char **argv){
+  FILE *in = stdin;
+  uint8_t r[RECORDSIZE];
+  int n = 0, c;
+
+  for(int i=1; i<argc; i++){
+    if(strcmp(argv[i], "--mhz") == 0 && i+1 < argc){
+      MHz = atoi(argv[++i]);
+      MHzFixed = 1;
+    } else if((in = fopen(argv[i], "rb")) == 0){
+      perror(argv[i]);
+      return 1;
+    }
+  }
+  printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  while((c = getc(in)) != EOF){
+    if(n == 0 && c != TRACESYNC){
+      Skipped++;              // bytes lost on the serial line
+      continue;
+    }
+    r[n++] = c;
+    if(n == RECORDSIZE){
+      n = 0;
+      if(r[1] > TRACE_LOST){  // not a record, look for the next sync byte
+        Skipped++;
+        for(int i=1; i<RECORDSIZE; i++){
+          if(r[i] == TRACESYNC){
+            memmove(r, &r[i], RECORDSIZE-i);
+            n = RECORDSIZE-i;
+            break;
+          }
+        }
+      } else{
+        event(r);
+      }
+    }
+  }
+  if(Running >= 0){
+    slice('E', Running, "running");
+  }
+  while(Nesting > 0){
+    Nesting--;
+    slice('E', ISRTRACK, Handlers[Nesting]);
+  }
+  printf("\n]}\n");
+  fprintf(stderr, "%u events, %.3f ms, %u lost by the OS, %u bytes skipped\n",
+          Events, us()/1000, Lost, Skipped);
+  return 0;
+}
@@ -114,6 +114,9 @@ static void runPeriodicThreads(void) {
   int32_t const timeElapsed = MS_PER_SECOND / UPDATE_PERIODIC_EVENT_THREAD_TIMER_FREQ;
   DisableInterrupts();
   for (int i = 0; i < NUMPERIODIC; i++) {
+    if (eventThreads[i].thread == 0) {
+      continue; // not added by OS_AddPeriodicEventThread
+    }
     decrementEventTimer(i, timeElapsed);
     if (eventThreads[i].timeUntilExecute == 0) {
       eventThreads[i].thread();
@@ -40,6 +40,7 @@
 #include "Texas.h"
 #include "CortexM.h"
 #include "os.h"
+#include "UART0.h"
 
 uint32_t sqrt32(uint32_t s);
 #define THREADFREQ 1000   // frequency in Hz of round robin scheduler
@@ -57,9 +58,9 @@ uint32_t SoundRMS;          // Root Mean Square average of most recent sound sam
 uint32_t LightData;         // 100 lux
 int32_t TemperatureData;    // 0.1C
 // semaphores
-int32_t NewData;  // true when new numbers to display on top of LCD
-int32_t LCDmutex; // exclusive access to LCD
-int32_t I2Cmutex; // exclusive access to I2C
+Sema4Type NewData;  // true when new numbers to display on top of LCD
+MutexType LCDmutex; // exclusive access to LCD
+MutexType I2Cmutex; // exclusive access to I2C
 int ReDrawAxes = 0;         // non-zero means redraw axes on next display task
 
 enum plotstate{
@@ -85,8 +86,8 @@ enum plotstate PlotState = Accelerometer;
 // High priority thread run by OS in real time at 1000 Hz
 #define SOUNDRMSLENGTH 1000 // number of samples to collect before calculating RMS (may overflow if greater than 4104)
 int16_t SoundArray[SOUNDRMSLENGTH];
-int32_t TakeSoundData; // binary semaphore
-int32_t ADCmutex;      // access to ADC
+Sema4Type TakeSoundData; // binary semaphore
+MutexType ADCmutex;      // access to ADC
 // *********Task0*********
 // Task0 measures sound intensity
 // Periodic main thread runs in real time at 1000 Hz
@@ -102,9 +103,9 @@ void Task0(void){
     OS_Wait(&TakeSoundData); // signaled by OS every 1ms
     TExaS_Task0();     // record system time in array, toggle virtual logic analyzer
     Profile_Toggle0(); // viewed by the logic analyzer to know Task0 started
-    OS_Wait(&ADCmutex);
+    OS_MutexLock(&ADCmutex);
     BSP_Microphone_Input(&SoundData);
-    OS_Signal(&ADCmutex);
+    OS_MutexUnlock(&ADCmutex);
     soundSum = soundSum + (int32_t)SoundData;
     SoundArray[time] = SoundData;
     time = time + 1;
@@ -122,7 +123,7 @@ void Task0(void){
 
 //---------------- Task1 measures acceleration ----------------
 // Event thread run by OS in real time at 10 Hz
-int32_t TakeAccelerationData;
+Sema4Type TakeAccelerationData;
 uint32_t LostTask1Data;     // number of times that the FIFO was full when acceleration data was ready
 uint16_t AccX, AccY, AccZ;  // returned by BSP as 10-bit numbers
 #define ALPHA 128           // The degree of weighting decrease, a constant smoothing factor between 0 and 1,023. A higher ALPHA discounts older observations faster.
@@ -153,9 +154,9 @@ void Task1(void){uint32_t squared;
     OS_Wait(&TakeAccelerationData); // signaled by OS every 100ms
     TExaS_Task1();     // records system time in array, toggles virtual logic analyzer
     Profile_Toggle1(); // viewed by the logic analyzer to know Task1 started
-    OS_Wait(&ADCmutex);
+    OS_MutexLock(&ADCmutex);
     BSP_Accelerometer_Input(&AccX, &AccY, &AccZ);
-    OS_Signal(&ADCmutex);
+    OS_MutexUnlock(&ADCmutex);
     squared = AccX*AccX + AccY*AccY + AccZ*AccZ;
     if(OS_FIFO_Put(squared) == -1){  // makes Task2 run every 100ms
       LostTask1Data = LostTask1Data + 1;
@@ -181,7 +182,7 @@ void Task1(void){uint32_t squared;
 #define TEMP_MAX 1023
 #define TEMP_MIN 0
 void drawaxes(void){
-  OS_Wait(&LCDmutex);
+  OS_MutexLock(&LCDmutex);
   if(PlotState == Accelerometer){
     BSP_LCD_Drawaxes(AXISCOLOR, BGCOLOR, "Time", "Mag", MAGCOLOR, "Ave", EWMACOLOR, ACCELERATION_MAX, ACCELERATION_MIN);
   } else if(PlotState == Microphone){
@@ -191,7 +192,7 @@ void drawaxes(void){
   } else if(PlotState == Light){
     BSP_LCD_Drawaxes(AXISCOLOR, BGCOLOR, "Time", "Light", LIGHTCOLOR, "", 0, LIGHT_MAX, LIGHT_MIN);
   }
-  OS_Signal(&LCDmutex);  ReDrawAxes = 0;
+  OS_MutexUnlock(&LCDmutex);  ReDrawAxes = 0;
 }
 void Task2(void){uint32_t data;
   uint32_t localMin;   // smallest measured magnitude since odd-numbered step detected
@@ -258,7 +259,7 @@ void Task2(void){uint32_t data;
       drawaxes();
       ReDrawAxes = 0;
     }
-    OS_Wait(&LCDmutex);
+    OS_MutexLock(&LCDmutex);
     if(PlotState == Accelerometer){
       BSP_LCD_PlotPoint(Magnitude, MAGCOLOR);
       BSP_LCD_PlotPoint(EWMA, EWMACOLOR);
@@ -270,7 +271,7 @@ void Task2(void){uint32_t data;
       BSP_LCD_PlotPoint(LightData, LIGHTCOLOR);
     }
     BSP_LCD_PlotIncrement();
-    OS_Signal(&LCDmutex);
+    OS_MutexUnlock(&LCDmutex);
   }
 }
 /* ****************************************** */
@@ -286,7 +287,7 @@ void Task2(void){uint32_t data;
 // checks the switches, updates the mode, and outputs to the buzzer and LED
 // Inputs:  none
 // Outputs: none
-int32_t SwitchTouch;
+Sema4Type SwitchTouch;
 void Task3(void){
   uint8_t current;
 	OS_InitSemaphore(&SwitchTouch,0); // signaled on touch button1
@@ -332,16 +333,16 @@ void Task4(void){int32_t voltData,tempData;
     TExaS_Task4();     // records system time in array, toggles virtual logic analyzer
     Profile_Toggle4(); // viewed by the logic analyzer to know Task4 started
 
-    OS_Wait(&I2Cmutex);
+    OS_MutexLock(&I2Cmutex);
     // BSP_TempSensor_Start();
-    OS_Signal(&I2Cmutex);
+    OS_MutexUnlock(&I2Cmutex);
     done = 0;
     OS_Sleep(1000);    // waits about 1 sec
     while(done == 0){
-      OS_Wait(&I2Cmutex);
+      OS_MutexLock(&I2Cmutex);
       // done = BSP_TempSensor_End(&voltData, &tempData);
       done = 1;
-      OS_Signal(&I2Cmutex);
+      OS_MutexUnlock(&I2Cmutex);
     }
     // TemperatureData = tempData/10000;
   }
@@ -362,12 +363,12 @@ void Task4(void){int32_t voltData,tempData;
 // Inputs:  none
 // Outputs: none
 void Task5(void){int32_t soundSum;
-  OS_Wait(&LCDmutex);
+  OS_MutexLock(&LCDmutex);
   BSP_LCD_DrawString(0,  0, "Temp=",  TOPTXTCOLOR);
   BSP_LCD_DrawString(0,  1, "Step=",  TOPTXTCOLOR);
   BSP_LCD_DrawString(10, 0, "Light=", TOPTXTCOLOR);
   BSP_LCD_DrawString(10, 1, "Sound=", TOPTXTCOLOR);
-  OS_Signal(&LCDmutex);
+  OS_MutexUnlock(&LCDmutex);
   while(1){
     OS_Wait(&NewData);
     TExaS_Task5();     // records system time in array, toggles virtual logic analyzer
@@ -377,7 +378,7 @@ void Task5(void){int32_t soundSum;
       soundSum = soundSum + (SoundArray[i] - SoundAvg)*(SoundArray[i] - SoundAvg);
     }
     SoundRMS = sqrt32(soundSum/SOUNDRMSLENGTH);
-    OS_Wait(&LCDmutex);
+    OS_MutexLock(&LCDmutex);
     BSP_LCD_SetCursor(5,  0); BSP_LCD_OutUFix2_1(TemperatureData, TEMPCOLOR);
     BSP_LCD_SetCursor(5,  1); BSP_LCD_OutUDec4(Steps,             MAGCOLOR);
     BSP_LCD_SetCursor(16, 0); BSP_LCD_OutUDec4(LightData,         LIGHTCOLOR);
@@ -388,7 +389,7 @@ void Task5(void){int32_t soundSum;
       BSP_LCD_SetCursor(0, 12); BSP_LCD_OutUDec4(LostTask1Data, BSP_LCD_Color565(255, 0, 0));
     }
 //end of debug code
-    OS_Signal(&LCDmutex);
+    OS_MutexUnlock(&LCDmutex);
   }
 }
 /* ****************************************** */
@@ -407,15 +408,15 @@ void Task6(void){ uint32_t lightData;
     TExaS_Task6();     // records system time in array, toggles virtual logic analyzer
     Profile_Toggle6(); // viewed by the logic analyzer to know Task6 started
 
-    OS_Wait(&I2Cmutex);
+    OS_MutexLock(&I2Cmutex);
     BSP_LightSensor_Start();
-    OS_Signal(&I2Cmutex);
+    OS_MutexUnlock(&I2Cmutex);
     done = 0;
     OS_Sleep(800);     // waits about 0.8 sec
     while(done == 0){
-      OS_Wait(&I2Cmutex);
+      OS_MutexLock(&I2Cmutex);
       done = BSP_LightSensor_End(&lightData);
-      OS_Signal(&I2Cmutex);
+      OS_MutexUnlock(&I2Cmutex);
     }
     LightData = lightData/100;
   }
@@ -424,18 +425,25 @@ void Task6(void){ uint32_t lightData;
 /*          End of Task6 Section              */
 /* ****************************************** */
 
-//---------------- Task7 dummy function ----------------
+//---------------- Task7 idle report ----------------
 // *********Task7*********
 // Main thread scheduled by OS round robin preemptive scheduler
-// Task7 does nothing but never blocks or sleeps
+// Task7 wakes once a second and reads the share of that second the
+// OS idle thread had, sleeping the processor in WFI, into
+// IdleTenths, 0.1% units, for the debugger watch window.
 // Inputs:  none
 // Outputs: none
 uint32_t Count7;
+uint32_t IdleTenths;
+OSStatsType Stats7;
 void Task7(void){
   Count7 = 0;
+  OS_GetStats(&Stats7);   // start the first one second window
   while(1){
+    OS_Sleep(1000);
+    OS_GetStats(&Stats7);
+    IdleTenths = Stats7.idle;
     Count7++;
-    WaitForInterrupt();
   }
 }
 /* ****************************************** */
@@ -456,10 +464,19 @@ void Task7(void){
 // Task4  temperature    periodically every 1 sec
 // Task5  numbers on LCD after Task0 runs SOUNDRMSLENGTH times
 // Task6  light          periodically every 800 ms
-// Task7  dummy          no timing requirement
+// Task7  idle report    every 1 sec, no timing requirement
+// Stacks, in 32-bit words, come from one arena in os.c.  The LCD
+// tasks get 128 and the I2C sensor tasks 96.  Task0, Task1, Task3,
+// Task7, which only sleeps and reads OS_GetStats, and the idle
+// thread need no more than STACKMIN (64).
+//   before: 9 stacks of 100 words       = 900 words, 3600 bytes
+//   after:  4*64+2*128+2*96 + 64 (idle) = 768 words, 3072 bytes
+// which saves 528 bytes while giving the LCD tasks more room.
+// STACKARENA is 96 words per thread, so StackArenaLeft reads 0.
 // Remember that you must have exactly one main() function, so
 // to work on this step, you must rename all other main()
 // functions in this file.
+uint32_t StackArenaLeft; // words of the stack arena no thread uses
 int main(void){
   OS_Init();
   Profile_Init();  // initialize the 7 hardware profiling pins
@@ -473,16 +490,17 @@ int main(void){
   BSP_TempSensor_Init();
   Time = 0;
   OS_InitSemaphore(&NewData, 0);  // 0 means no data
-  OS_InitSemaphore(&LCDmutex, 1); // 1 means free
-  OS_InitSemaphore(&I2Cmutex, 1); // 1 means free
+  OS_InitMutex(&LCDmutex);       // free
+  OS_InitMutex(&I2Cmutex);       // free
   OS_InitSemaphore(&TakeSoundData,0);
-  OS_InitSemaphore(&ADCmutex,1);
+  OS_InitMutex(&ADCmutex);
   BSP_Microphone_Init();
   BSP_Accelerometer_Init();
   OS_InitSemaphore(&TakeAccelerationData,0);
   OS_FIFO_Init();                 // initialize FIFO used to send data between Task1 and Task2
-  OS_AddThreads(&Task0,0, &Task1,1, &Task2,2, &Task3,3, 
-	              &Task4,3, &Task5,3, &Task6,3, &Task7,4);
+  OS_AddThreads(&Task0,0,STACKMIN, &Task1,1,STACKMIN, &Task2,2,128, &Task3,3,STACKMIN,
+	              &Task4,3,96, &Task5,3,128, &Task6,3,96, &Task7,4,STACKMIN);
+  StackArenaLeft = OS_StackArenaFree();
 	OS_PeriodTrigger0_Init(&TakeSoundData,1);  // every 1 ms
 	OS_PeriodTrigger1_Init(&TakeAccelerationData,100); //every 100ms
   // when grading change 1000 to 4-digit number from edX
@@ -525,7 +543,7 @@ int n;             // loop counter
 // Remember that you must have exactly one main() function, so
 // to work on this step, you must rename all other main()
 // functions in this file.
-int32_t sAB,sCD,sEF;
+Sema4Type sAB,sCD,sEF;
 int32_t CountA,CountB,CountC,CountD,CountE,CountF,CountG,CountH;
 void TaskA(void){ // producer highest priority
   CountA = 0;
@@ -602,8 +620,8 @@ int main_step1(void){
   OS_InitSemaphore(&sAB, 0);
   OS_InitSemaphore(&sCD, 0);
   OS_InitSemaphore(&sEF, 0);
-  OS_AddThreads(&TaskA,0, &TaskB,1, &TaskC,2, &TaskD,3,
-   	&TaskE,4, &TaskF,5, &TaskG,6, &TaskH,7);
+  OS_AddThreads(&TaskA,0,STACKMIN, &TaskB,1,STACKMIN, &TaskC,2,STACKMIN, &TaskD,3,STACKMIN,
+   	&TaskE,4,STACKMIN, &TaskF,5,STACKMIN, &TaskG,6,STACKMIN, &TaskH,7,STACKMIN);
   TExaS_Init(LOGICANALYZER, 1000); // initialize the Lab 4 grader
 //  TExaS_Init(GRADESTEP1, 1000);    // initialize the Lab 4 grader
   OS_Launch(BSP_Clock_GetFreq()/1000);
@@ -628,8 +646,8 @@ int main_step1(void){
 // Remember that you must have exactly one main() function, so
 // to work on this step, you must rename all other main()
 // functions in this file.
-int32_t sIJ,sKL,sMN;
-int32_t sI,sK;
+Sema4Type sIJ,sKL,sMN;
+Sema4Type sI,sK;
 int32_t CountI,CountJ,CountK,CountL,CountM,CountN,CountO,CountP;
 void TaskI(void){ // producer highest priority
   CountI = 0;
@@ -711,8 +729,8 @@ int main_step2(void){
   OS_InitSemaphore(&sMN, 0);
 	OS_PeriodTrigger0_Init(&sI,20);  // every 20 ms
 	OS_PeriodTrigger1_Init(&sK,50);  // every 50ms
-  OS_AddThreads(&TaskI,0, &TaskJ,1, &TaskK,2, &TaskL,3,
-   	&TaskM,4, &TaskN,5, &TaskO,6, &TaskP,7);
+  OS_AddThreads(&TaskI,0,STACKMIN, &TaskJ,1,STACKMIN, &TaskK,2,STACKMIN, &TaskL,3,STACKMIN,
+   	&TaskM,4,STACKMIN, &TaskN,5,STACKMIN, &TaskO,6,STACKMIN, &TaskP,7,STACKMIN);
   TExaS_Init(LOGICANALYZER, 1000); // initialize the Lab 4 grader
 //  TExaS_Init(GRADESTEP2, 1000);    // initialize the Lab 4 grader
   OS_Launch(BSP_Clock_GetFreq()/1000);
@@ -736,8 +754,8 @@ int main_step2(void){
 // Remember that you must have exactly one main() function, so
 // to work on this step, you must rename all other main()
 // functions in this file.
-int32_t sQR;
-int32_t sQ;
+Sema4Type sQR;
+Sema4Type sQ;
 int32_t CountQ,CountR;
 void TaskQ(void){ // producer
   CountQ = 0;
@@ -772,8 +790,8 @@ int main_step3(void){
 	OS_PeriodTrigger0_Init(&sI,50);   // every 50 ms
 	OS_PeriodTrigger1_Init(&sK,200);  // every 200ms
 	OS_EdgeTrigger_Init(&sQ,2);
-  OS_AddThreads(&TaskI,0, &TaskJ,1, &TaskK,2, &TaskL,3,
-   	&TaskQ,4, &TaskR,5, &TaskO,6, &TaskP,7);
+  OS_AddThreads(&TaskI,0,STACKMIN, &TaskJ,1,STACKMIN, &TaskK,2,STACKMIN, &TaskL,3,STACKMIN,
+   	&TaskQ,4,STACKMIN, &TaskR,5,STACKMIN, &TaskO,6,STACKMIN, &TaskP,7,STACKMIN);
   TExaS_Init(LOGICANALYZER, 1000); // initialize the Lab 4 grader
 //  TExaS_Init(GRADESTEP3, 1000);    // initialize the Lab 4 grader
   OS_Launch(BSP_Clock_GetFreq()/1000);
@@ -782,3 +800,1054 @@ int main_step3(void){
 /* ****************************************** */
 /*          End of Step 3 Section             */
 /* ****************************************** */
+
+//---------------- Step 7 ----------------
+// Step 7 measures the cost of one scheduling decision.  Threads
+// are added in batches of 8, and at 8, 16 and 32 threads both the
+// bitmap scheduler and the original linear scan are timed with the
+// DWT cycle counter.  OS_Launch is never called, so the schedulers
+// run back to back from main.  Build os.c with NUMTHREADS set to 32
+// to get all three columns; sizes above NUMTHREADS are left at 0.
+// Build it with LINEARSCAN 1 too, or SchedCyclesLinear stays 0.
+// Priorities cycle through 0 to 7, so several threads share
+// the highest level.
+// Results are read from the debugger watch window.
+// Remember that you must have exactly one main() function, so
+// to work on this step, you must rename all other main()
+// functions in this file.
+void Scheduler(void);
+#if LINEARSCAN
+void SchedulerLinearScan(void);
+#endif
+#define BENCHLOOPS 1000
+uint32_t BenchThreads[3] = {8, 16, 32};
+uint32_t SchedCyclesBitmap[3];  // average cycles per Scheduler() call
+uint32_t SchedCyclesLinear[3];  // average cycles per SchedulerLinearScan() call
+int32_t CountS;
+void TaskS(void){ // never runs, the OS is not launched
+  CountS = 0;
+  while(1){
+    CountS++;
+  }
+}
+uint32_t benchscheduler(void(*scheduler)(void)){
+  uint32_t start, overhead, total = 0;
+  start = DWT_CYCCNT;
+  overhead = DWT_CYCCNT - start; // cost of reading the counter
+  for(int i=0; i<BENCHLOOPS; i++){
+    start = DWT_CYCCNT;
+    scheduler();
+    total = total + (DWT_CYCCNT - start) - overhead;
+  }
+  return total/BENCHLOOPS;
+}
+int main_step7(void){
+  uint32_t added = 0;
+  OS_Init();
+  DEMCR |= 0x01000000;    // TRCENA, enable the DWT unit
+  DWT_CYCCNT = 0;
+  DWT_CTRL |= 0x00000001; // CYCCNTENA, start the cycle counter
+  for(int n=0; n<3; n++){
+    while(added < BenchThreads[n]){
+      if(OS_AddThread(&TaskS, added%8, STACKMIN) == 0){
+        break;            // NUMTHREADS is smaller than this size
+      }
+      added++;
+    }
+    if(added < BenchThreads[n]){
+      break;
+    }
+    SchedCyclesBitmap[n] = benchscheduler(&Scheduler);
+#if LINEARSCAN
+    SchedCyclesLinear[n] = benchscheduler(&SchedulerLinearScan);
+#endif
+  }
+  while(1){};             // inspect SchedCyclesBitmap and SchedCyclesLinear
+}
+/* ****************************************** */
+/*          End of Step 7 Section             */
+/* ****************************************** */
+
+//---------------- Step 8 ----------------
+// Step 8 measures signal-to-wake latency, the cycles from the moment
+// TaskV calls OS_Signal until TaskW, blocked on sW, runs again.
+// TaskW is added first and TaskV second, so the thread to wake is the
+// last one reached going around the TCB ring from TaskV.  Every other
+// TCB is filled with TaskX, blocked on sFill, which is never signaled.
+// The first BENCHLOOPS wakeups use OS_Signal, which takes TaskW off the
+// head of the sW queue, and the next BENCHLOOPS use the original ring
+// search in OS_SignalLinearScan.  Both times include the PendSV
+// context switch the signal triggers.  Build os.c with NUMTHREADS set
+// to 8, 16 and 32 to see how each grows with the number of threads,
+// and with LINEARSCAN 1, or every wakeup uses OS_Signal.
+// Results are read from the debugger watch window.
+// Remember that you must have exactly one main() function, so
+// to work on this step, you must rename all other main()
+// functions in this file.
+#if LINEARSCAN
+void OS_SignalLinearScan(Sema4Type *semaPt);
+#endif
+Sema4Type sW,sFill;
+uint32_t SignalStart;       // DWT_CYCCNT just before the signal
+uint32_t WakeCount;         // number of times TaskW has woken
+uint32_t WakeCyclesQueue;   // average signal-to-wake cycles with OS_Signal
+uint32_t WakeCyclesLinear;  // average signal-to-wake cycles with OS_SignalLinearScan
+void TaskW(void){ // woken by TaskV, highest priority
+  uint32_t total = 0;
+  WakeCount = 0;
+  while(1){
+    OS_Wait(&sW);
+    total = total + (DWT_CYCCNT - SignalStart);
+    WakeCount++;
+    if(WakeCount == BENCHLOOPS){
+      WakeCyclesQueue = total/BENCHLOOPS;
+      total = 0;
+    }
+    if(WakeCount == 2*BENCHLOOPS){
+      WakeCyclesLinear = total/BENCHLOOPS;
+    }
+  }
+}
+void TaskV(void){ // signals TaskW
+  while(1){
+    SignalStart = DWT_CYCCNT;
+#if LINEARSCAN
+    if((WakeCount >= BENCHLOOPS) && (WakeCount < 2*BENCHLOOPS)){
+      OS_SignalLinearScan(&sW);
+      continue;
+    }
+#endif
+    OS_Signal(&sW); // TaskW preempts TaskV right here
+  }
+}
+void TaskX(void){ // blocks forever
+  OS_Wait(&sFill);
+  while(1){};
+}
+int main_step8(void){
+  OS_Init();
+  DEMCR |= 0x01000000;    // TRCENA, enable the DWT unit
+  DWT_CYCCNT = 0;
+  DWT_CTRL |= 0x00000001; // CYCCNTENA, start the cycle counter
+  OS_InitSemaphore(&sW, 0);
+  OS_InitSemaphore(&sFill, 0);
+  OS_AddThread(&TaskW, 0, STACKMIN);
+  OS_AddThread(&TaskV, 1, STACKMIN);
+  while(OS_AddThread(&TaskX, 2, STACKMIN)){}; // fill the rest of the TCBs
+  OS_Launch(BSP_Clock_GetFreq()/1000);
+  return 0;             // this never executes
+}
+/* ****************************************** */
+/*          End of Step 8 Section             */
+/* ****************************************** */
+
+//---------------- Step 9 ----------------
+// Step 9 measures priority inversion.  TaskLow (priority 2) holds a
+// lock for 2 ms at a time.  Every 10 ms TaskHigh (priority 0) and
+// TaskMedium (priority 1) wake together.  TaskHigh asks for the lock
+// and usually finds TaskLow holding it, then TaskMedium spins for 5 ms.
+// With a counting semaphore as the lock TaskMedium runs ahead of
+// TaskLow, so TaskHigh waits for both.  With OS_Mutex TaskLow inherits
+// priority 0 and TaskHigh only waits for the rest of the 2 ms.
+// The first INVERSIONROUNDS use InversionSema, the next use
+// InversionMutex, and the worst blocking time of each is kept in us.
+// Results are read from the debugger watch window.
+// Remember that you must have exactly one main() function, so
+// to work on this step, you must rename all other main()
+// functions in this file.
+#define INVERSIONROUNDS 100
+Sema4Type InversionSema;
+MutexType InversionMutex;
+uint32_t InversionRounds;     // number of times TaskHigh has taken the lock
+uint32_t WorstBlockSema;      // longest wait by TaskHigh in us, semaphore lock
+uint32_t WorstBlockMutex;     // longest wait by TaskHigh in us, OS_Mutex lock
+uint32_t CountMedium,CountLow;
+int inversionlock(void){ // returns 1 if it took the mutex
+  if(InversionRounds < INVERSIONROUNDS){
+    OS_Wait(&InversionSema);
+    return 0;
+  }
+  OS_MutexLock(&InversionMutex);
+  return 1;
+}
+void inversionunlock(int mutex){
+  if(mutex){
+    OS_MutexUnlock(&InversionMutex);
+  } else{
+    OS_Signal(&InversionSema);
+  }
+}
+void TaskHigh(void){
+  uint32_t wake = OS_MsTime();
+  uint32_t start, blocked;
+  int mutex;
+  InversionRounds = 0;
+  while(1){
+    wake = wake + 10;
+    OS_SleepUntil(wake);
+    start = DWT_CYCCNT;
+    mutex = inversionlock();
+    blocked = (DWT_CYCCNT - start)/(BSP_Clock_GetFreq()/1000000);
+    if(mutex){
+      if(blocked > WorstBlockMutex){
+        WorstBlockMutex = blocked;
+      }
+    } else if(blocked > WorstBlockSema){
+      WorstBlockSema = blocked;
+    }
+    inversionunlock(mutex);
+    InversionRounds++;
+  }
+}
+void TaskMedium(void){
+  uint32_t wake = OS_MsTime();
+  CountMedium = 0;
+  while(1){
+    wake = wake + 10;
+    OS_SleepUntil(wake);
+    CountMedium++;
+    BSP_Delay1ms(5);       // busy, does not need the lock
+  }
+}
+void TaskLow(void){
+  int mutex;
+  CountLow = 0;
+  while(1){
+    mutex = inversionlock();
+    CountLow++;
+    BSP_Delay1ms(2);       // use the shared resource
+    inversionunlock(mutex);
+    OS_Sleep(1);
+  }
+}
+int main_step9(void){
+  OS_Init();
+  DEMCR |= 0x01000000;    // TRCENA, enable the DWT unit
+  DWT_CYCCNT = 0;
+  DWT_CTRL |= 0x00000001; // CYCCNTENA, start the cycle counter
+  OS_InitSemaphore(&InversionSema, 1);
+  OS_InitMutex(&InversionMutex);
+  OS_AddThread(&TaskHigh, 0, STACKMIN);
+  OS_AddThread(&TaskMedium, 1, STACKMIN);
+  OS_AddThread(&TaskLow, 2, STACKMIN);
+  OS_Launch(BSP_Clock_GetFreq()/1000);
+  return 0;             // this never executes
+}
+/* ****************************************** */
+/*          End of Step 9 Section             */
+/* ****************************************** */
+
+//---------------- Step 10 ----------------
+// Step 10 runs the Step 6 fitness task set with Task7 replaced by
+// a report of how much of each stack has been used and how much
+// of the CPU each thread took over the last second, sent every
+// second over UART0 (115,200 bps) to a terminal on the PC.  A thread
+// whose high-water mark stays well under its size can have its
+// stack shrunk in Step 6.  For Task0 and Task1 it also shows the
+// periodic jobs run, the deadlines missed and the worst lateness in
+// us, negative while every job has finished before the next release,
+// so the real-time requirement is checked live instead of by the
+// TExaS grader.  Last is the longest time the OS kept interrupts
+// masked, the latency it adds to every interrupt that may call it.
+// The grader is not started, it shares UART0.
+// Remember that you must have exactly one main() function, so
+// to work on this step, you must rename all other main()
+// functions in this file.
+const uint32_t Step10Stacks[8] = {STACKMIN, STACKMIN, 128, STACKMIN, 96, 128, 96, STACKMIN};
+OSStatsType Stats;
+DeadlineStatsType Deadlines;
+void outPercent(uint32_t tenths){ // 0.1% units
+  UART0_OutUDec(tenths/10);
+  UART0_OutChar('.');
+  UART0_OutUDec(tenths%10);
+  UART0_OutChar('%');
+}
+void outLateness(int32_t us){
+  if(us < 0){
+    UART0_OutChar('-');
+    us = -us;
+  }
+  UART0_OutUDec(us);
+}
+void StatsReport(void){uint32_t id;
+  OS_GetStats(&Stats);   // start the first one second window
+  while(1){
+    OS_Sleep(1000);
+    OS_GetStats(&Stats);
+    UART0_OutString("\n\rThread Used/Size  CPU  Jobs Missed Late(us)");
+    for(id=0; id<8; id++){
+      UART0_OutString("\n\r     ");
+      UART0_OutUDec(id);
+      UART0_OutString("  ");
+      UART0_OutUDec(OS_StackUsage(id));
+      UART0_OutChar('/');
+      UART0_OutUDec(Step10Stacks[id]);
+      UART0_OutString("  ");
+      outPercent(Stats.thread[id]);
+      OS_GetDeadlines(id, &Deadlines);
+      if(Deadlines.jobs || Deadlines.misses){ // only the periodic threads
+        UART0_OutString("  ");
+        UART0_OutUDec(Deadlines.jobs);
+        UART0_OutString("  ");
+        UART0_OutUDec(Deadlines.misses);
+        UART0_OutString("  ");
+        outLateness(Deadlines.worstLateness);
+      }
+    }
+    UART0_OutString("\n\r   ISR  "); outPercent(Stats.isr);
+    UART0_OutString("\n\r  Idle  "); outPercent(Stats.idle);
+    UART0_OutString("\n\rMasked  "); UART0_OutUDec(Stats.maskedWorst); UART0_OutString(" us");
+  }
+}
+int main_step10(void){
+  OS_Init();
+  Profile_Init();  // initialize the 7 hardware profiling pins
+  UART0_Init();
+  BSP_Button1_Init();
+  BSP_Button2_Init();
+  BSP_RGB_Init(0, 0, 0);
+  BSP_Buzzer_Init(0);
+  BSP_LCD_Init();
+  BSP_LCD_FillScreen(BSP_LCD_Color565(0, 0, 0));
+  BSP_LightSensor_Init();
+  BSP_TempSensor_Init();
+  Time = 0;
+  OS_InitSemaphore(&NewData, 0);  // 0 means no data
+  OS_InitMutex(&LCDmutex);       // free
+  OS_InitMutex(&I2Cmutex);       // free
+  OS_InitSemaphore(&TakeSoundData,0);
+  OS_InitMutex(&ADCmutex);
+  BSP_Microphone_Init();
+  BSP_Accelerometer_Init();
+  OS_InitSemaphore(&TakeAccelerationData,0);
+  OS_FIFO_Init();                 // initialize FIFO used to send data between Task1 and Task2
+  OS_AddThreads(&Task0,0,Step10Stacks[0], &Task1,1,Step10Stacks[1], &Task2,2,Step10Stacks[2],
+                &Task3,3,Step10Stacks[3], &Task4,3,Step10Stacks[4], &Task5,3,Step10Stacks[5],
+                &Task6,3,Step10Stacks[6], &StatsReport,4,Step10Stacks[7]);
+	OS_PeriodTrigger0_Init(&TakeSoundData,1);  // every 1 ms
+	OS_PeriodTrigger1_Init(&TakeAccelerationData,100); //every 100ms
+  OS_Launch(BSP_Clock_GetFreq()/THREADFREQ); // doesn't return, interrupts enabled in here
+  return 0;             // this never executes
+}
+/* ****************************************** */
+/*          End of Step 10 Section            */
+/* ****************************************** */
+
+//---------------- Step 11 ----------------
+// Step 11 measures the cost of one 1 ms tick of the timer wheel
+// with 8, 32 and 128 software timers running, against a linear
+// countdown like the eventThreads[] loop of the Lab 3 kernel.
+// Periods are spread from 100 ms to one hour.  OS_Launch is never
+// called, so the ticks run back to back from main, BENCHTICKS of
+// each, and the DWT cycle counter times every one.
+// Results are read from the debugger watch window.
+// Remember that you must have exactly one main() function, so
+// to work on this step, you must rename all other main()
+// functions in this file.
+void TimerWheelTick(void);
+#define BENCHTIMERS 128
+#define BENCHTICKS 10000
+uint32_t BenchTimerCount[3] = {8, 32, 128};
+uint32_t WheelTickCycles[3];  // average cycles per TimerWheelTick()
+uint32_t WheelTickWorst[3];   // longest TimerWheelTick() in cycles
+uint32_t LinearTickCycles[3]; // average cycles per linear countdown tick
+uint32_t TimerCallbacks;
+TimerType BenchTimers[BENCHTIMERS];
+struct{
+  void (*thread)(void);
+  uint32_t period;
+  uint32_t timeUntilExecute;
+} LinearTimers[BENCHTIMERS];
+void TimerCallback(void){
+  TimerCallbacks++;
+}
+void lineartick(uint32_t n){
+  for(uint32_t i=0; i<n; i++){
+    LinearTimers[i].timeUntilExecute--;
+    if(LinearTimers[i].timeUntilExecute == 0){
+      LinearTimers[i].thread();
+      LinearTimers[i].timeUntilExecute = LinearTimers[i].period;
+    }
+  }
+}
+int main_step11(void){
+  uint32_t start, overhead, cycles, wheelTotal, linearTotal, period;
+  OS_Init();
+  DEMCR |= 0x01000000;    // TRCENA, enable the DWT unit
+  DWT_CYCCNT = 0;
+  DWT_CTRL |= 0x00000001; // CYCCNTENA, start the cycle counter
+  start = DWT_CYCCNT;
+  overhead = DWT_CYCCNT - start; // cost of reading the counter
+  for(int n=0; n<3; n++){
+    for(uint32_t i=0; i<BENCHTIMERS; i++){
+      OS_TimerStop(&BenchTimers[i]);
+    }
+    for(uint32_t i=0; i<BenchTimerCount[n]; i++){
+      period = 100 + (i*104729)%3600000; // 100 ms to 1 hour
+      OS_InitTimer(&BenchTimers[i], &TimerCallback);
+      OS_TimerStart(&BenchTimers[i], period, period);
+      LinearTimers[i].thread = &TimerCallback;
+      LinearTimers[i].period = period;
+      LinearTimers[i].timeUntilExecute = period;
+    }
+    wheelTotal = linearTotal = 0;
+    for(int t=0; t<BENCHTICKS; t++){
+      start = DWT_CYCCNT;
+      TimerWheelTick();
+      cycles = DWT_CYCCNT - start - overhead;
+      wheelTotal = wheelTotal + cycles;
+      if(cycles > WheelTickWorst[n]){
+        WheelTickWorst[n] = cycles;
+      }
+      start = DWT_CYCCNT;
+      lineartick(BenchTimerCount[n]);
+      linearTotal = linearTotal + (DWT_CYCCNT - start) - overhead;
+    }
+    WheelTickCycles[n] = wheelTotal/BENCHTICKS;
+    LinearTickCycles[n] = linearTotal/BENCHTICKS;
+  }
+  while(1){};             // inspect WheelTickCycles, WheelTickWorst and LinearTickCycles
+}
+/* ****************************************** */
+/*          End of Step 11 Section            */
+/* ****************************************** */
+
+//---------------- Step 12 ----------------
+// Step 12 moves the slow part of an interrupt handler to the kernel
+// work thread.  A 1 kHz Wide Timer4A handler samples the microphone
+// into one of two blocks.  When a block fills, its RMS has to be
+// found and shown on the LCD.  With DEFERWORK 0 the RMS is found in
+// the handler and the LCD is left alone, since the handler can not
+// wait for LCDmutex.  With DEFERWORK 1 the handler posts the block to
+// the work thread and returns; the work item finds the RMS and waits
+// for the LCD like any thread.  The DWT cycle counter times the
+// longest handler, SamplerWorst, and the longest wait from a post
+// to the start of its work item, WorkLatencyWorst.
+// Results are read from the debugger watch window.
+// Remember that you must have exactly one main() function, so
+// to work on this step, you must rename all other main()
+// functions in this file.
+#define DEFERWORK 1
+#define BLOCKLENGTH 250
+int16_t SoundBlock[2][BLOCKLENGTH]; // one is filled while the other is used
+uint32_t SamplerWorst;      // cycles in the longest handler
+uint32_t PostCycles;        // DWT_CYCCNT when the last block was posted
+uint32_t WorkLatencyWorst;  // most cycles from post to work item start
+uint32_t BlocksDone;        // RMS values found
+uint32_t LostBlocks;        // blocks the work queue had no room for
+// finds the RMS of one block of sound samples
+uint32_t blockRMS(int16_t *block){int32_t sum = 0, avg, squares = 0;
+  for(int i=0; i<BLOCKLENGTH; i=i+1){
+    sum = sum + block[i];
+  }
+  avg = sum/BLOCKLENGTH;
+  for(int i=0; i<BLOCKLENGTH; i=i+1){
+    squares = squares + (block[i] - avg)*(block[i] - avg);
+  }
+  return sqrt32(squares/BLOCKLENGTH);
+}
+// work item, runs in the work thread with interrupts enabled
+void SoundWork(uint32_t block){uint32_t latency;
+  latency = DWT_CYCCNT - PostCycles;
+  if(latency > WorkLatencyWorst){
+    WorkLatencyWorst = latency;
+  }
+  SoundRMS = blockRMS(SoundBlock[block]);
+  BlocksDone++;
+  OS_MutexLock(&LCDmutex);   // blocks, which a handler can never do
+  BSP_LCD_SetCursor(16, 1); BSP_LCD_OutUDec4(SoundRMS, SOUNDCOLOR);
+  OS_MutexUnlock(&LCDmutex);
+}
+// Wide Timer4A handler, 1 kHz
+void SoundSampler(void){static uint32_t block = 0, count = 0;
+  uint32_t start = DWT_CYCCNT;
+  uint16_t sample;
+  BSP_Microphone_Input(&sample);
+  SoundBlock[block][count] = (int16_t)sample;
+  count = count + 1;
+  if(count == BLOCKLENGTH){
+#if DEFERWORK
+    PostCycles = DWT_CYCCNT;
+    if(OS_WorkPost(&SoundWork, block) == 0){
+      LostBlocks++;
+    }
+#else
+    SoundRMS = blockRMS(SoundBlock[block]);
+    BlocksDone++;
+#endif
+    block = block^1;
+    count = 0;
+  }
+  if(DWT_CYCCNT - start > SamplerWorst){
+    SamplerWorst = DWT_CYCCNT - start;
+  }
+}
+int main_step12(void){
+  OS_Init();
+  Profile_Init();  // initialize the 7 hardware profiling pins
+  BSP_LCD_Init();
+  BSP_LCD_FillScreen(BSP_LCD_Color565(0, 0, 0));
+  BSP_LCD_DrawString(10, 1, "Sound=", TOPTXTCOLOR);
+  BSP_Microphone_Init();
+  OS_InitMutex(&LCDmutex);
+  OS_WorkQueue_Init(0, 128);     // above every main thread
+  BSP_PeriodicTask_InitB(&SoundSampler, 1000, 1);
+  OS_Launch(BSP_Clock_GetFreq()/THREADFREQ); // doesn't return, interrupts enabled in here
+  return 0;             // this never executes
+}
+/* ****************************************** */
+/*          End of Step 12 Section            */
+/* ****************************************** */
+
+//---------------- Step 13 ----------------
+// Step 13 lets threads wait on several sources through one event
+// group instead of a semaphore and a helper thread for each.  A 10 ms
+// software timer polls the two buttons in the OS timer interrupt and
+// sets two flags when one is pressed, one for each waiting thread.
+// ButtonAny wakes on either press and clears what it saw; ButtonChord
+// only wakes once both buttons have been pressed since it last ran.
+// The counts are read from the debugger watch window.
+// Remember that you must have exactly one main() function, so
+// to work on this step, you must rename all other main()
+// functions in this file.
+#define BUTTON1EVENT 0x01  // for ButtonAny
+#define BUTTON2EVENT 0x02
+#define CHORD1EVENT  0x04  // for ButtonChord
+#define CHORD2EVENT  0x08
+EventGroupType Buttons;
+TimerType ButtonTimer;
+uint32_t Button1Presses, Button2Presses, Chords;
+void ButtonPoll(void){static uint8_t last1 = 1, last2 = 1; // 0 means pressed
+  uint8_t now1 = BSP_Button1_Input();
+  uint8_t now2 = BSP_Button2_Input();
+  if(last1 && (now1 == 0)){
+    OS_EventSet(&Buttons, BUTTON1EVENT|CHORD1EVENT);
+  }
+  if(last2 && (now2 == 0)){
+    OS_EventSet(&Buttons, BUTTON2EVENT|CHORD2EVENT);
+  }
+  last1 = now1;
+  last2 = now2;
+}
+void ButtonAny(void){uint32_t events;
+  while(1){
+    events = OS_EventWait(&Buttons, BUTTON1EVENT|BUTTON2EVENT, EVENT_ANY|EVENT_CLEAR);
+    if(events&BUTTON1EVENT){
+      Button1Presses++;
+    }
+    if(events&BUTTON2EVENT){
+      Button2Presses++;
+    }
+  }
+}
+void ButtonChord(void){
+  while(1){
+    OS_EventWait(&Buttons, CHORD1EVENT|CHORD2EVENT, EVENT_ALL|EVENT_CLEAR);
+    Chords++;
+  }
+}
+int main_step13(void){
+  OS_Init();
+  Profile_Init();  // initialize the 7 hardware profiling pins
+  BSP_Button1_Init();
+  BSP_Button2_Init();
+  OS_InitEventGroup(&Buttons);
+  OS_AddThread(&ButtonAny, 1, STACKMIN);
+  OS_AddThread(&ButtonChord, 2, STACKMIN);
+  OS_InitTimer(&ButtonTimer, &ButtonPoll);
+  OS_TimerStart(&ButtonTimer, 10, 10);
+  OS_Launch(BSP_Clock_GetFreq()/THREADFREQ); // doesn't return, interrupts enabled in here
+  return 0;             // this never executes
+}
+/* ****************************************** */
+/*          End of Step 13 Section            */
+/* ****************************************** */
+
+//---------------- Step 14 ----------------
+// Step 14 replaces the single FIFO of 32-bit words with message
+// queues.  Two producer threads send Reading structs to one queue
+// and a logger receives them, giving up after 500 ms so it notices
+// when the producers stop.  A 1 kHz Wide Timer4A handler sends
+// each microphone sample to a second queue without waiting, and
+// SoundBurst takes them SOUNDBURST at a time.
+// The counts are read from the debugger watch window.
+// Remember that you must have exactly one main() function, so
+// to work on this step, you must rename all other main()
+// functions in this file.
+#define SOUNDBURST 32
+typedef struct{
+  uint32_t source;     // 0 for the accelerometer, 1 for SoundLevel
+  uint32_t time;       // OS_MsTime() when it was read
+  uint32_t value;
+} ReadingType;
+ReadingType ReadingBuf[8];
+QueueType Readings;
+int16_t SoundBuf[2*SOUNDBURST];
+QueueType Sounds;
+uint32_t SoundLevel;       // peak to peak of the last burst
+uint32_t ReadingsLogged, ReadingTimeouts, SoundBursts, SoundSamples;
+void AccelProducer(void){ReadingType r;
+  uint16_t x, y, z;
+  r.source = 0;
+  while(1){
+    BSP_Accelerometer_Input(&x, &y, &z);
+    r.time = OS_MsTime();
+    r.value = x*x + y*y + z*z;
+    OS_QueueSend(&Readings, &r, WAIT_FOREVER);
+    OS_Sleep(100);
+  }
+}
+void LevelProducer(void){ReadingType r;
+  r.source = 1;
+  while(1){
+    r.time = OS_MsTime();
+    r.value = SoundLevel;
+    OS_QueueSend(&Readings, &r, WAIT_FOREVER);
+    OS_Sleep(250);
+  }
+}
+void ReadingLogger(void){ReadingType r;
+  while(1){
+    if(OS_QueueRecv(&Readings, &r, 500)){
+      ReadingsLogged++;
+    }
+    else{
+      ReadingTimeouts++;
+    }
+  }
+}
+void SoundBurst(void){int16_t samples[SOUNDBURST];
+  uint32_t n;
+  int16_t min, max;
+  while(1){
+    n = OS_QueueRecvBurst(&Sounds, samples, SOUNDBURST, WAIT_FOREVER);
+    min = max = samples[0];
+    for(int i=1; i<n; i=i+1){
+      if(samples[i] < min) min = samples[i];
+      if(samples[i] > max) max = samples[i];
+    }
+    SoundLevel = max - min;
+    SoundSamples = SoundSamples + n;
+    SoundBursts++;
+    OS_Sleep(20);        // let samples collect, so the next burst is full
+  }
+}
+// Wide Timer4A handler, 1 kHz, Sounds.lost counts samples dropped
+void SoundSender(void){uint16_t sample;
+  int16_t value;
+  BSP_Microphone_Input(&sample);
+  value = (int16_t)sample;
+  OS_QueueSend(&Sounds, &value, 0);
+}
+int main_step14(void){
+  OS_Init();
+  Profile_Init();  // initialize the 7 hardware profiling pins
+  BSP_Accelerometer_Init();
+  BSP_Microphone_Init();
+  OS_QueueInit(&Readings, ReadingBuf, sizeof(ReadingType), 8);
+  OS_QueueInit(&Sounds, SoundBuf, sizeof(int16_t), 2*SOUNDBURST);
+  OS_AddThread(&SoundBurst, 1, STACKMIN);
+  OS_AddThread(&AccelProducer, 2, STACKMIN);
+  OS_AddThread(&LevelProducer, 2, STACKMIN);
+  OS_AddThread(&ReadingLogger, 3, STACKMIN);
+  BSP_PeriodicTask_InitB(&SoundSender, 1000, 1);
+  OS_Launch(BSP_Clock_GetFreq()/THREADFREQ); // doesn't return, interrupts enabled in here
+  return 0;             // this never executes
+}
+/* ****************************************** */
+/*          End of Step 14 Section            */
+/* ****************************************** */
+
+//---------------- Step 15 ----------------
+// Step 15 times the 1 kHz microphone handler with two ways to hand
+// samples to a thread.  With USERING 0 it sends each sample to a
+// message queue, which disables interrupts on every call.  With
+// USERING 1 it puts them in a lock-free ring, which only disables
+// interrupts to wake the consumer once every SOUNDBURST samples.
+// The DWT cycle counter gives the longest handler, PutWorst, and
+// PutCycles/PutCount gives the average.
+// Results are read from the debugger watch window.
+// Remember that you must have exactly one main() function, so
+// to work on this step, you must rename all other main()
+// functions in this file.
+#define USERING 1
+uint32_t SoundRingBuf[2*SOUNDBURST];
+RingType SoundRing;
+uint32_t PutWorst, PutCycles, PutCount;
+void SoundConsumer(void){uint32_t sample;
+#if USERING
+  while(1){
+    OS_RingWait(&SoundRing, WAIT_FOREVER);
+    while(OS_RingGet(&SoundRing, &sample)){
+      SoundSamples++;
+    }
+    SoundBursts++;
+  }
+#else
+  int16_t samples[SOUNDBURST];
+  while(1){
+    SoundSamples = SoundSamples + OS_QueueRecvBurst(&Sounds, samples, SOUNDBURST, WAIT_FOREVER);
+    SoundBursts++;
+    OS_Sleep(SOUNDBURST-1); // let the rest of the burst collect
+  }
+#endif
+}
+// Wide Timer4A handler, 1 kHz
+void SoundPut(void){uint16_t sample;
+  uint32_t start, cycles;
+  BSP_Microphone_Input(&sample);
+  start = DWT_CYCCNT;
+#if USERING
+  OS_RingPut(&SoundRing, sample);
+#else
+  int16_t value = (int16_t)sample;
+  OS_QueueSend(&Sounds, &value, 0);
+#endif
+  cycles = DWT_CYCCNT - start;
+  PutCycles = PutCycles + cycles;
+  PutCount++;
+  if(cycles > PutWorst){
+    PutWorst = cycles;
+  }
+}
+int main_step15(void){
+  OS_Init();
+  Profile_Init();  // initialize the 7 hardware profiling pins
+  BSP_Microphone_Init();
+  OS_RingInit(&SoundRing, SoundRingBuf, 2*SOUNDBURST, SOUNDBURST);
+  OS_QueueInit(&Sounds, SoundBuf, sizeof(int16_t), 2*SOUNDBURST);
+  OS_AddThread(&SoundConsumer, 1, STACKMIN);
+  BSP_PeriodicTask_InitB(&SoundPut, 1000, 1);
+  OS_Launch(BSP_Clock_GetFreq()/THREADFREQ); // doesn't return, interrupts enabled in here
+  return 0;             // this never executes
+}
+/* ****************************************** */
+/*          End of Step 15 Section            */
+/* ****************************************** */
+
+//---------------- Step 16 ----------------
+// Step 16 counts the cycles semaphores and mutexes take with and
+// without a thread to block or wake.  TaskGiver times each call on a
+// free semaphore and an unowned mutex, then hands sHandoff and
+// mBench to TaskTaker, which is blocked on them, and TaskTaker times
+// the wait from the call to when it runs again.  Build os.c with
+// FASTSEMA4 set to 1 and to 0 to compare the LDREX/STREX fast path
+// with disabling interrupts for every call.  Only the uncontended
+// counts should change.
+// Results are read from the debugger watch window.
+// Remember that you must have exactly one main() function, so
+// to work on this step, you must rename all other main()
+// functions in this file.
+Sema4Type sFree, sHandoff, sNever;
+MutexType mBench;
+uint32_t HandoffStart;     // DWT_CYCCNT just before TaskGiver wakes TaskTaker
+uint32_t SignalCycles, WaitCycles, LockCycles, UnlockCycles; // uncontended averages
+uint32_t SignalWakeCycles, UnlockWakeCycles;                 // contended averages
+void TaskTaker(void){uint32_t total = 0;
+  for(int i=0; i<BENCHLOOPS; i=i+1){
+    OS_Wait(&sHandoff);
+    total = total + (DWT_CYCCNT - HandoffStart);
+  }
+  SignalWakeCycles = total/BENCHLOOPS;
+  total = 0;
+  for(int i=0; i<BENCHLOOPS; i=i+1){
+    OS_Wait(&sHandoff);    // TaskGiver owns mBench now
+    OS_MutexLock(&mBench);
+    total = total + (DWT_CYCCNT - HandoffStart);
+    OS_MutexUnlock(&mBench);
+  }
+  UnlockWakeCycles = total/BENCHLOOPS;
+  OS_Wait(&sNever);
+}
+void TaskGiver(void){uint32_t start, signal = 0, wait = 0, lock = 0, unlock = 0;
+  for(int i=0; i<BENCHLOOPS; i=i+1){
+    start = DWT_CYCCNT; OS_Signal(&sFree);      signal = signal + (DWT_CYCCNT - start);
+    start = DWT_CYCCNT; OS_Wait(&sFree);        wait = wait + (DWT_CYCCNT - start);
+    start = DWT_CYCCNT; OS_MutexLock(&mBench);  lock = lock + (DWT_CYCCNT - start);
+    start = DWT_CYCCNT; OS_MutexUnlock(&mBench);unlock = unlock + (DWT_CYCCNT - start);
+  }
+  SignalCycles = signal/BENCHLOOPS;
+  WaitCycles = wait/BENCHLOOPS;
+  LockCycles = lock/BENCHLOOPS;
+  UnlockCycles = unlock/BENCHLOOPS;
+  for(int i=0; i<BENCHLOOPS; i=i+1){
+    HandoffStart = DWT_CYCCNT;
+    OS_Signal(&sHandoff);  // TaskTaker preempts TaskGiver right here
+  }
+  for(int i=0; i<BENCHLOOPS; i=i+1){
+    OS_MutexLock(&mBench);
+    OS_Signal(&sHandoff);  // TaskTaker runs and blocks on mBench
+    HandoffStart = DWT_CYCCNT;
+    OS_MutexUnlock(&mBench);
+  }
+  while(1){};
+}
+int main_step16(void){
+  OS_Init();
+  DEMCR |= 0x01000000;    // TRCENA, enable the DWT unit
+  DWT_CYCCNT = 0;
+  DWT_CTRL |= 0x00000001; // CYCCNTENA, start the cycle counter
+  OS_InitSemaphore(&sFree, 0);
+  OS_InitSemaphore(&sHandoff, 0);
+  OS_InitSemaphore(&sNever, 0);
+  OS_InitMutex(&mBench);
+  OS_AddThread(&TaskTaker, 0, STACKMIN);
+  OS_AddThread(&TaskGiver, 1, STACKMIN);
+  OS_Launch(BSP_Clock_GetFreq()/1000);
+  return 0;             // this never executes
+}
+/* ****************************************** */
+/*          End of Step 16 Section            */
+/* ****************************************** */
+
+//---------------- Step 17 ----------------
+// Step 17 keeps a consumer running when its producer stalls.
+// SensorProducer mails a reading every 100 ms, but stops while
+// button 1 is held, like a sensor that stops answering.  Reporter
+// waits at most 250 ms for each reading; on a timeout it counts a
+// stall and turns the LED red instead of freezing, and turns it
+// green again when readings come back.
+// The counts are read from the debugger watch window.
+// Remember that you must have exactly one main() function, so
+// to work on this step, you must rename all other main()
+// functions in this file.
+uint32_t Readings17, Stalls;
+void SensorProducer(void){uint32_t reading = 0;
+  while(1){
+    if(BSP_Button1_Input()){ // 0 means pressed
+      OS_MailBox_Send(reading);
+      reading++;
+    }
+    OS_Sleep(100);
+  }
+}
+void Reporter(void){uint32_t reading;
+  while(1){
+    if(OS_MailBox_RecvTimeout(&reading, 250)){
+      Readings17++;
+      BSP_RGB_D_Set(0, 1, 0);
+    }
+    else{
+      Stalls++;
+      BSP_RGB_D_Set(1, 0, 0);
+    }
+  }
+}
+int main_step17(void){
+  OS_Init();
+  Profile_Init();  // initialize the 7 hardware profiling pins
+  BSP_Button1_Init();
+  BSP_RGB_D_Init(0, 0, 0);
+  OS_MailBox_Init();
+  OS_AddThread(&SensorProducer, 1, STACKMIN);
+  OS_AddThread(&Reporter, 2, STACKMIN);
+  OS_Launch(BSP_Clock_GetFreq()/THREADFREQ); // doesn't return, interrupts enabled in here
+  return 0;             // this never executes
+}
+/* ****************************************** */
+/*          End of Step 17 Section            */
+/* ****************************************** */
+
+//---------------- Step 18 ----------------
+// Step 18 records what the OS does while Step 17 runs and sends it
+// over UART0 (115,200 bps) for a timeline on the PC.  Set TRACE to 1
+// in os.h, capture the UART to a file and convert it with
+// HostSim/TraceJson.c, then open the result in ui.perfetto.dev to see
+// when each thread ran, every semaphore wait and signal, and the
+// interrupts in between.  The UART carries about 1,280 events a
+// second, so a busier task set, like Step 6, should trace only some
+// event types, such as 1<<TRACE_SWITCH.
+// The grader is not started, it shares UART0.
+// Remember that you must have exactly one main() function, so
+// to work on this step, you must rename all other main()
+// functions in this file.
+#if TRACE
+int main_step18(void){
+  OS_Init();
+  Profile_Init();  // initialize the 7 hardware profiling pins
+  UART0_Init();
+  BSP_Button1_Init();
+  BSP_RGB_D_Init(0, 0, 0);
+  OS_MailBox_Init();
+  OS_AddThread(&SensorProducer, 1, STACKMIN);
+  OS_AddThread(&Reporter, 2, STACKMIN);
+  OS_AddThread(&OS_TraceThread, 4, STACKMIN);
+  OS_TraceStart(TRACE_ALL);
+  OS_Launch(BSP_Clock_GetFreq()/THREADFREQ); // doesn't return, interrupts enabled in here
+  return 0;             // this never executes
+}
+#endif
+/* ****************************************** */
+/*          End of Step 18 Section            */
+/* ****************************************** */
+
+//---------------- Step 19 ----------------
+// Step 19 is a benchmark of the kernel itself, one number for each
+// service the tasks above lean on, all timed with the DWT cycle
+// counter:
+//   Switch   cycles from one thread calling OS_Suspend until the next
+//            thread at its priority runs
+//   Signal, Wait          cycles for an OS_Signal or OS_Wait that
+//                         wakes or blocks no one
+//   SignalWake, WaitBlock cycles from an OS_Signal until the higher
+//                         priority thread it wakes runs, and from an
+//                         OS_Wait that blocks until the next thread runs
+//   Put, Get cycles for each OS_FIFO_Put and OS_FIFO_Get
+//   Sleep    us late (or early if negative) waking from OS_Sleep(1)
+//            to OS_Sleep(10), worst both ways
+//   Jitter   cycles a 1 ms OS_PeriodTrigger0_Init thread runs away
+//            from its period, worst both ways, while the rest runs
+// BenchControl runs each measurement in turn, then sends the results
+// once over UART0 (115,200 bps) to a terminal on the PC.  They are
+// also in Bench, in the debugger watch window.  Build os.c with the
+// variant to compare, for example FASTSEMA4 0 or TICKLESS 1, and run
+// it again.  HostSim/RtosSim.c runs this step as step19 and prints the
+// same report, so a change to os.c can be checked without a board.
+// The grader is not started, it shares UART0.
+// Remember that you must have exactly one main() function, so
+// to work on this step, you must rename all other main()
+// functions in this file.
+struct{
+  uint32_t switchCycles;
+  uint32_t signalCycles, waitCycles;
+  uint32_t signalWakeCycles, waitBlockCycles;
+  uint32_t putCycles, getCycles;
+  int32_t sleepEarly, sleepLate; // us
+  int32_t jitterEarly, jitterLate;
+} Bench;
+Sema4Type sPeer, sFree19, sWake, sJitter, sJitterDone;
+uint32_t WakeStart;        // DWT_CYCCNT just before BenchControl signals sWake
+uint32_t WaitStart;        // DWT_CYCCNT just before BenchWaiter blocks on sWake
+uint32_t WakeTotal;
+void BenchPeer(void){ // takes turns with BenchControl
+  while(1){
+    OS_Wait(&sPeer);     // its last turn ends blocked here
+    for(int i=1; i<BENCHLOOPS; i=i+1){
+      OS_Suspend();
+    }
+  }
+}
+void BenchWaiter(void){ // woken by BenchControl, higher priority
+  while(1){
+    WaitStart = DWT_CYCCNT;
+    OS_Wait(&sWake);     // BenchControl runs again right here
+    WakeTotal = WakeTotal + (DWT_CYCCNT - WakeStart);
+  }
+}
+void BenchPeriodic(void){uint32_t last, period, n = 0;
+  int32_t error;
+  period = BSP_Clock_GetFreq()/1000;
+  OS_Wait(&sJitter);
+  last = DWT_CYCCNT;
+  while(n < BENCHLOOPS){
+    OS_Wait(&sJitter);
+    error = (int32_t)(DWT_CYCCNT - last - period);
+    last = DWT_CYCCNT;
+    if(error < Bench.jitterEarly){
+      Bench.jitterEarly = error;
+    }
+    if(error > Bench.jitterLate){
+      Bench.jitterLate = error;
+    }
+    n++;
+  }
+  OS_Signal(&sJitterDone);
+  while(1){
+    OS_Wait(&sJitter);   // keep up with the releases
+  }
+}
+void outBench(char *name, int32_t value, char *units){
+  UART0_OutString("\n\r");
+  UART0_OutString(name);
+  UART0_OutChar(' ');
+  outLateness(value);
+  UART0_OutString(units);
+}
+void BenchControl(void){uint32_t start, overhead, total, total2, msCycles;
+  int32_t error;
+  start = DWT_CYCCNT;
+  overhead = DWT_CYCCNT - start; // cost of reading the counter
+  msCycles = BSP_Clock_GetFreq()/1000;
+  // context switch, BenchPeer and BenchControl take turns
+  OS_Signal(&sPeer);
+  start = DWT_CYCCNT;
+  for(int i=0; i<BENCHLOOPS; i=i+1){
+    OS_Suspend();
+  }
+  Bench.switchCycles = (DWT_CYCCNT - start)/(2*BENCHLOOPS);
+  // uncontended semaphore
+  total = total2 = 0;
+  for(int i=0; i<BENCHLOOPS; i=i+1){
+    start = DWT_CYCCNT; OS_Signal(&sFree19); total = total + (DWT_CYCCNT - start) - overhead;
+    start = DWT_CYCCNT; OS_Wait(&sFree19);   total2 = total2 + (DWT_CYCCNT - start) - overhead;
+  }
+  Bench.signalCycles = total/BENCHLOOPS;
+  Bench.waitCycles = total2/BENCHLOOPS;
+  // contended semaphore, BenchWaiter is blocked on sWake
+  WakeTotal = total = 0;
+  for(int i=0; i<BENCHLOOPS; i=i+1){
+    WakeStart = DWT_CYCCNT;
+    OS_Signal(&sWake);   // BenchWaiter preempts BenchControl right here
+    total = total + (DWT_CYCCNT - WaitStart);
+  }
+  Bench.signalWakeCycles = WakeTotal/BENCHLOOPS;
+  Bench.waitBlockCycles = total/BENCHLOOPS;
+  // FIFO, never full and never empty
+  total = total2 = 0;
+  for(int i=0; i<BENCHLOOPS; i=i+1){
+    start = DWT_CYCCNT; OS_FIFO_Put(i); total = total + (DWT_CYCCNT - start) - overhead;
+    start = DWT_CYCCNT; OS_FIFO_Get();  total2 = total2 + (DWT_CYCCNT - start) - overhead;
+  }
+  Bench.putCycles = total/BENCHLOOPS;
+  Bench.getCycles = total2/BENCHLOOPS;
+  // sleep, in us
+  for(uint32_t ms=1; ms<=10; ms++){
+    start = DWT_CYCCNT;
+    OS_Sleep(ms);
+    error = (int32_t)(DWT_CYCCNT - start - ms*msCycles)/(int32_t)(msCycles/1000);
+    if(error < Bench.sleepEarly){
+      Bench.sleepEarly = error;
+    }
+    if(error > Bench.sleepLate){
+      Bench.sleepLate = error;
+    }
+  }
+  OS_Wait(&sJitterDone);
+  UART0_OutString("\n\rKernel benchmark");
+  outBench("Switch      ", Bench.switchCycles, " cycles");
+  outBench("Signal      ", Bench.signalCycles, " cycles");
+  outBench("Wait        ", Bench.waitCycles, " cycles");
+  outBench("SignalWake  ", Bench.signalWakeCycles, " cycles");
+  outBench("WaitBlock   ", Bench.waitBlockCycles, " cycles");
+  outBench("Put         ", Bench.putCycles, " cycles");
+  outBench("Get         ", Bench.getCycles, " cycles");
+  outBench("Sleep early ", Bench.sleepEarly, " us");
+  outBench("Sleep late  ", Bench.sleepLate, " us");
+  outBench("Jitter early", Bench.jitterEarly, " cycles");
+  outBench("Jitter late ", Bench.jitterLate, " cycles");
+  UART0_OutString("\n\r");
+  OS_Wait(&sPeer);       // done, never signaled again
+}
+int main_step19(void){
+  OS_Init();
+  UART0_Init();
+  DEMCR |= 0x01000000;    // TRCENA, enable the DWT unit
+  DWT_CYCCNT = 0;
+  DWT_CTRL |= 0x00000001; // CYCCNTENA, start the cycle counter
+  OS_InitSemaphore(&sPeer, 0);
+  OS_InitSemaphore(&sFree19, 0);
+  OS_InitSemaphore(&sWake, 0);
+  OS_InitSemaphore(&sJitter, 0);
+  OS_InitSemaphore(&sJitterDone, 0);
+  OS_FIFO_Init();
+  OS_AddThread(&BenchWaiter, 0, STACKMIN);
+  OS_AddThread(&BenchPeriodic, 0, STACKMIN);
+  OS_AddThread(&BenchControl, 1, 128);
+  OS_AddThread(&BenchPeer, 1, STACKMIN);
+  OS_PeriodTrigger0_Init(&sJitter, 1);      // every 1 ms
+  OS_Launch(BSP_Clock_GetFreq()/THREADFREQ); // doesn't return, interrupts enabled in here
+  return 0;             // this never executes
+}
+/* ****************************************** */
+/*          End of Step 19 Section            */
+/* ****************************************** */
@@ -6,72 +6,606 @@
 // March 25, 2016
 // Hint: Copy solutions from Lab 3 into Lab 4
 #include <stdint.h>
+#include <string.h>
 #include "os.h"
 #include "CortexM.h"
 #include "BSP.h"
+#include "UART0.h"
 #include "../inc/tm4c123gh6pm.h"
 
 // function definitions in osasm.s
 void StartOS(void);
 
+#ifndef NUMTHREADS
 #define NUMTHREADS  8        // maximum number of threads
-#define NUMPERIODIC 2        // maximum number of periodic threads
-#define STACKSIZE   100      // number of 32-bit words in stack per thread
+#endif
+#ifndef STACKARENA
+#define STACKARENA  (NUMTHREADS*96) // 32-bit words shared by all stacks, idle thread included
+#endif
+#define STACKFILL   0x5A5A5A5A // stack words no thread has written yet
+#define STACKGUARD  0xDEADC0DE // lowest word of every stack, overwritten on overflow
+#define EXCRETURN   8        // index from sp of the saved EXC_RETURN, after R4-R11
+#define NUMPRIORITIES 32     // priority levels, 0 (highest) to 31 (lowest)
+#define IDLETHREAD  NUMTHREADS        // index of the kernel idle thread in tcbs
+#define WORKTHREAD  (NUMTHREADS+1)    // index of the kernel work thread in tcbs
+#define WORKSIZE    16       // work items the queue holds, a power of 2
+#define IDLEPRIORITY (NUMPRIORITIES-1) // idle thread runs below every main thread
+#ifndef TICKLESS
+#define TICKLESS    0        // 1 to wake on one-shot timer deadlines instead of periodic ticks
+#endif
+#ifndef EDF
+#define EDF         0        // 1 to run the threads with a deadline earliest deadline first
+#endif
+#ifndef FASTSEMA4
+#define FASTSEMA4   1        // 1 to take and give free semaphores and mutexes with LDREX/STREX
+#endif
+#define EDFPRIORITY 0        // priority of every thread with a deadline when EDF is 1
+#define MAXDEADLINE 20000    // longest period or deadline in ms, under 2^31 cycles
+#define MAXDENSITY  1000000  // the whole CPU in ppm, the admission limit
+#ifdef __arm__
+#define MEMORYBARRIER() __asm volatile("dmb" ::: "memory") // finish memory accesses before going on
+#define LDREX(addr)        __builtin_arm_ldrex(addr)         // load and mark addr for exclusive access
+#define STREX(value, addr) __builtin_arm_strex(value, addr)  // store if still exclusive, 0 if it stored
+#define CLREX()            __builtin_arm_clrex()             // give up exclusive access
+#else
+// Host builds model the exclusive monitor.  The host simulators can
+// run an interrupt handler at the start of any basic block, so they
+// clear ExclusiveMonitor on every exception entry, as the Cortex-M
+// does, and HostStrex, which runs in the simulator where no handler
+// can cut in, fails once it is clear, so the fast path tries again.
+extern uint32_t ExclusiveMonitor;                      // defined by the simulator
+int HostStrex(void *addr, uintptr_t value, uint32_t size); // 0 if it stored
+#define MEMORYBARRIER() __asm volatile("" ::: "memory")    // host builds, keeps the compiler's order
+#define LDREX(addr)        (ExclusiveMonitor = 1, *(addr))
+#define STREX(value, addr) HostStrex((addr), (uintptr_t)(value), sizeof(*(addr)))
+#define CLREX()            (ExclusiveMonitor = 0)
+#endif
 struct tcb{
   int32_t *sp;       // pointer to stack (valid for threads not running
   struct tcb *next;  // linked-list pointer
-  int32_t * blocked; // nonzero if blocked on this semaphore
-  uint32_t sleepTime; // nonzero if this thread is sleeping
-  uint32_t priority;
+  Sema4Type *blocked; // nonzero if blocked on this semaphore
+  struct tcb *waitNext; // next thread blocked on the same semaphore
+  uint32_t sleepTime; // ms after the thread ahead of it in SleepList
+  uint32_t sleeping; // nonzero if this thread is in SleepList
+  struct tcb *sleepNext; // next thread to wake up
+  uint32_t priority; // current priority, raised while it blocks a higher one
+  uint32_t basePriority; // priority given by OS_AddThread
+  MutexType *waitMutex; // nonzero if blocked on this mutex
+  MutexType *heldMutex; // mutexes owned by this thread, 0 if none
+  struct tcb *readyNext; // next ready thread with the same priority
+  struct tcb *readyPrev; // previous ready thread with the same priority
+  uint32_t usesFPU;  // nonzero if S0-S31 were saved when it last stopped running
+  int32_t *stack;    // lowest word of its stack in StackArena
+  uint32_t stackSize; // number of 32-bit words in its stack
+  uint64_t runCycles; // cycles it has run since the last OS_GetStats
+  uint32_t jobsDone; // periodic jobs it has finished
+  uint32_t deadlineMisses; // periodic jobs still running at their deadline
+  int32_t worstLateness; // most cycles a job finished after its deadline
+  uint32_t relDeadline; // cycles from the start of a job to its deadline, 0 if none
+  uint32_t absDeadline; // DWT_CYCCNT when the current job is due
+  uint32_t jobEnded; // nonzero from the end of a job until the next one starts
+  uint32_t density; // ppm of the CPU its jobs may need, wcet/min(deadline,period)
+  uint32_t eventMask; // flags it is blocked waiting for in an event group
+  uint32_t eventOptions; // EVENT_ANY or EVENT_ALL, and EVENT_CLEAR
+  uint32_t eventFlags; // flags that woke it
+  uint32_t timedOut; // nonzero if its last timed wait ran out first
 };
 typedef struct tcb tcbType;
-tcbType tcbs[NUMTHREADS];
+tcbType tcbs[NUMTHREADS+2];   // two extra for the idle and work threads
 tcbType *RunPt;
-int32_t Stacks[NUMTHREADS][STACKSIZE];
+int64_t StackArena[STACKARENA/2]; // double words, so every stack is 8-byte aligned
+uint32_t StackUsed;                // words of StackArena given to threads
+tcbType *StackOverflowPt;          // thread that ran off the bottom of its stack
+uint32_t SwitchCycles;             // DWT_CYCCNT when RunPt was last charged
+uint32_t IsrStartCycles;           // DWT_CYCCNT on entry to the outermost OS handler
+uint32_t IsrNesting;               // number of OS handlers running
+uint64_t IsrCycles;                // cycles in OS handlers since the last OS_GetStats
+uint32_t KernelMask = KERNELPRIORITY<<5; // BASEPRI in the kernel, priority in bits 7-5
+uint32_t MaskStart;                // DWT_CYCCNT when the kernel masked interrupts
+uint32_t MaskWorst;                // most cycles masked since the last OS_GetStats
+uint32_t NumThread = 0;            // number of threads added
+tcbType *ReadyHead[NUMPRIORITIES]; // next thread to run at each priority, 0 if none ready
+uint32_t ReadyBitmap;              // bit (31-p) is set if priority p has a ready thread
+tcbType *SleepList;                // sleeping threads in the order they wake up
+uint32_t OSTime;                   // ms since OS_Launch
+uint32_t WheelTime;                // ms the timer wheel has been run up to
+#define NUMTRIGGERS 2        // OS_PeriodTrigger0_Init and OS_PeriodTrigger1_Init
+#define PERIODICSTART 10     // ms before the first release, so all the threads execute once
+typedef struct{
+  Sema4Type *semaPt;         // semaphore to signal, 0 if not in use
+  uint32_t period;           // ms between releases
+  uint32_t periodCycles;     // bus cycles between releases
+  uint32_t nextRelease;      // ms time of the next release
+  uint32_t releaseCycles;    // DWT_CYCCNT at the release of the oldest unfinished job
+  uint32_t jobs;             // jobs released and not yet finished
+  tcbType *threadPt;         // thread that waits on semaPt, 0 until it first does
+} TriggerType;
+TriggerType Triggers[NUMTRIGGERS];
+uint32_t RealTime;                 // ms counted by RealTimeEvents
+uint32_t DeadlineDensity;          // ppm of the CPU admitted by OS_SetDeadline
 void static runperiodicevents(void);
 
-typedef struct {
-  void (*thread)(void);
-  uint32_t period;
-  uint32_t timeUntilExecute;
-} eventThread;
 
-eventThread eventThreads[NUMPERIODIC];
+void SetInitialStack(int i);
+void Scheduler(void);
+void TimerWheelTick(void);
+static void finishJob(Sema4Type * semaPt);
+static void removeSleepingThread(tcbType * threadPt);
+#if TICKLESS
+static void advanceOSTime(void);
+static void startWakeupTimer(void);
+static void ticklessStart(void);
+#endif
 
+//****kernel critical sections************
+// The kernel masks interrupts by raising BASEPRI to KernelMask, so
+// interrupts at a higher priority than KERNELPRIORITY, the ones
+// numbered below it, keep running with no added latency even inside
+// the OS.  They must never call the OS.  With KERNELPRIORITY 0 the
+// kernel masks every interrupt with PRIMASK, as it used to.
+#if KERNELPRIORITY && defined(__arm__)
+// ******** maskKernel ************
+// Raises BASEPRI to KernelMask, never lowers it
+// Input: None
+// Output: BASEPRI before, 0 if nothing was masked
+static long maskKernel(void) {
+  long sr;
 
-void SetInitialStack(int i);
+  __asm volatile("mrs %0, basepri" : "=r"(sr));
+  __asm volatile("msr basepri_max, %0" :: "r"(KernelMask) : "memory");
+  return sr;
+}
 
-// ******** initializeThread ************
-// Initializes a thread's stack and tcb data
-// Input: the number of the thread to initialize
+// ******** unmaskKernel ************
+// Input: BASEPRI from maskKernel
 // Output: None
-static void initializeThread(int threadNum) {
-  SetInitialStack(threadNum);
-  
-  tcbs[threadNum].blocked = 0;
-  tcbs[threadNum].sleepTime = 0;
+static void unmaskKernel(long sr) {
+  __asm volatile("msr basepri, %0" :: "r"(sr) : "memory");
+}
+#else
+#define maskKernel()     StartCritical()
+#define unmaskKernel(sr) EndCritical(sr)
+#endif
+
+// ******** OS_StartCritical ************
+// Mask the interrupts that may call the OS, and time how long
+// they stay masked if they were not already
+// Inputs:  none
+// Outputs: mask to pass to OS_EndCritical
+long OS_StartCritical(void){
+  long const sr = maskKernel();
+
+  if (sr == 0) {
+    MaskStart = DWT_CYCCNT;
+  }
+  return sr;
+}
+
+// ******** OS_EndCritical ************
+// Restore the mask from OS_StartCritical
+// Inputs:  mask OS_StartCritical returned
+// Outputs: none
+void OS_EndCritical(long sr){
+  if (sr == 0) {
+    uint32_t const masked = DWT_CYCCNT - MaskStart;
+
+    if (masked > MaskWorst) {
+      MaskWorst = masked;
+    }
+  }
+  unmaskKernel(sr);
+}
 
-  if (threadNum == NUMTHREADS-1) {
-    tcbs[threadNum].next = &tcbs[0];
+//****event trace************
+// With TRACE 1 the kernel records what it does in TraceRing, each
+// event stamped with DWT_CYCCNT, and OS_TraceDrain sends them over
+// UART0 as 9-byte records: TRACESYNC, type, thread, arg (2 bytes)
+// and cycles (4 bytes), least significant byte first.
+// HostSim/TraceJson.c turns a capture into a Chrome/Perfetto trace.
+// Events that find the ring full are counted and reported in a
+// TRACE_LOST event once there is room.
+#if TRACE
+#define TRACESIZE   256      // events TraceRing holds, a power of 2
+#define TRACESYNC   0xA5     // first byte of every record sent
+#define TRACEISR    0xFF     // thread field of an event made in an ISR
+typedef struct{
+  uint32_t cycles;         // DWT_CYCCNT when it happened
+  uint16_t arg;            // depends on the type
+  uint8_t type;            // TRACE_SWITCH ...
+  uint8_t thread;          // TCB index, or TRACEISR
+} TraceType;
+TraceType TraceRing[TRACESIZE];
+volatile uint32_t TracePutI; // events recorded, free running
+volatile uint32_t TraceGetI; // events sent
+uint32_t TraceLost;        // events not recorded since the last TRACE_LOST
+uint32_t TraceMask;        // 1<<type for each type being recorded
+
+// ******** traceEvent ************
+// Records an event in TraceRing if its type is being traced
+// Input: TRACE_SWITCH ... TRACE_LOST
+//        thread it concerns
+//        argument, depends on the type
+// Output: None
+static void traceEvent(uint32_t type, uint32_t thread, uint32_t arg) {
+  long sr;
+
+  if ((TraceMask & (1u << type)) == 0) {
     return;
   }
+  sr = maskKernel();
+  if (TraceLost != 0 && TracePutI - TraceGetI < TRACESIZE) {
+    TraceType * const lostPt = &TraceRing[TracePutI & (TRACESIZE-1)];
+
+    lostPt->cycles = DWT_CYCCNT;
+    lostPt->arg = (TraceLost > 0xFFFF) ? 0xFFFF : TraceLost;
+    lostPt->type = TRACE_LOST;
+    lostPt->thread = TRACEISR;
+    TracePutI++;
+    TraceLost = 0;
+  }
+  if (TracePutI - TraceGetI < TRACESIZE) {
+    TraceType * const eventPt = &TraceRing[TracePutI & (TRACESIZE-1)];
+
+    eventPt->cycles = DWT_CYCCNT;
+    eventPt->arg = arg;
+    eventPt->type = type;
+    eventPt->thread = thread;
+    TracePutI++;
+  }
+  else {
+    TraceLost++;
+  }
+  unmaskKernel(sr);
+}
 
-  tcbs[threadNum].next = &tcbs[threadNum+1];
+// ******** traceContext ************
+// Input: None
+// Output: TCB index of RunPt, or TRACEISR if called from an ISR
+static uint32_t traceContext(void) {
+  if (INTCTRL & 0x1FF) {  // VECTACTIVE, the exception being handled
+    return TRACEISR;
+  }
+  return RunPt - tcbs;
 }
 
-// ******** wakeupBlockedThread ************
-// Searches threads for next thread blocked by semaphore
+// ******** OS_TraceStart ************
+// Empty the trace buffer and start recording the given event types
+// Inputs:  1<<TRACE_SWITCH | ... for the types to record, TRACE_ALL for all
+// Outputs: none
+void OS_TraceStart(uint32_t mask){
+  long const sr = OS_StartCritical();
+
+  TraceGetI = TracePutI;
+  TraceLost = 0;
+  TraceMask = mask | (1u << TRACE_START) | (1u << TRACE_LOST);
+  traceEvent(TRACE_START, NUMTHREADS, BSP_Clock_GetFreq()/1000000);
+  OS_EndCritical(sr);
+}
+
+// ******** OS_TraceDrain ************
+// Send the recorded events over UART0, each as 9 bytes:
+// TRACESYNC, type, thread, arg and cycles, least significant byte first
+// Inputs:  none
+// Outputs: number of events sent
+uint32_t OS_TraceDrain(void){
+  uint32_t count = 0;
+
+  while (TraceGetI != TracePutI) {
+    TraceType const event = TraceRing[TraceGetI & (TRACESIZE-1)];
+
+    TraceGetI++;   // the event is copied, so its slot may be reused
+    UART0_OutChar(TRACESYNC);
+    UART0_OutChar(event.type);
+    UART0_OutChar(event.thread);
+    UART0_OutChar(event.arg & 0xFF);
+    UART0_OutChar(event.arg >> 8);
+    UART0_OutChar(event.cycles & 0xFF);
+    UART0_OutChar((event.cycles >> 8) & 0xFF);
+    UART0_OutChar((event.cycles >> 16) & 0xFF);
+    UART0_OutChar(event.cycles >> 24);
+    count++;
+  }
+  return count;
+}
+
+// ******** OS_TraceThread ************
+// Main thread that sends the recorded events every 10 ms
+// Inputs:  none
+// Outputs: none
+void OS_TraceThread(void){
+  while (1) {
+    OS_TraceDrain();
+    OS_Sleep(10);
+  }
+}
+#define TRACEEVENT(type, thread, arg) traceEvent(type, thread, arg)
+#define TRACESEMA(semaPt) ((uint32_t)(uintptr_t)(semaPt) & 0xFFFF) // low half of its RAM address
+#else
+#define TRACEEVENT(type, thread, arg)
+#endif
+
+#if EDF
+// ******** earlierDeadline ************
+// Tests whether one thread's job is due before another's.
+// A thread with no deadline is due after every thread with one.
+// Input: two threads
+// Output: 1 if the first is due strictly earlier, 0 if not
+static int earlierDeadline(tcbType * threadPt, tcbType * otherPt) {
+  if (threadPt->relDeadline == 0) {
+    return 0;
+  }
+  if (otherPt->relDeadline == 0) {
+    return 1;
+  }
+  return (int32_t)(threadPt->absDeadline - otherPt->absDeadline) < 0;
+}
+#endif
+
+// ******** addReadyThread ************
+// Appends a thread to the tail of the ready list for its priority,
+// so it runs after the threads already waiting at that priority.
+// With EDF the EDFPRIORITY list is kept in deadline order instead,
+// so its head is always the job due first.
 // Called with interrupts disabled
-// Input: pointer to semaphore that some thread(s) are blocked on
+// Input: thread that has become ready to run
+// Output: None
+static void addReadyThread(tcbType * threadPt) {
+  uint32_t const priority = threadPt->priority;
+  tcbType * const head = ReadyHead[priority];
+  tcbType * nextPt = head;   // thread to go in front of
+
+  if (head == 0) {
+    threadPt->readyNext = threadPt;
+    threadPt->readyPrev = threadPt;
+    ReadyHead[priority] = threadPt;
+    ReadyBitmap |= (0x80000000 >> priority);
+    return;
+  }
+
+#if EDF
+  if (priority == EDFPRIORITY) {
+    if (earlierDeadline(threadPt, head)) {
+      ReadyHead[priority] = threadPt;
+    } 
+    else {
+      do {                   // behind every job due at the same time or earlier
+        nextPt = nextPt->readyNext;
+      } while (nextPt != head && !earlierDeadline(threadPt, nextPt));
+    }
+  }
+#endif
+  threadPt->readyNext = nextPt;
+  threadPt->readyPrev = nextPt->readyPrev;
+  nextPt->readyPrev->readyNext = threadPt;
+  nextPt->readyPrev = threadPt;
+}
+
+// ******** removeReadyThread ************
+// Unlinks a thread from the ready list for its priority
+// Called with interrupts disabled
+// Input: thread that is about to block or sleep
+// Output: None
+static void removeReadyThread(tcbType * threadPt) {
+  uint32_t const priority = threadPt->priority;
+
+  if (threadPt->readyNext == threadPt) {
+    ReadyHead[priority] = 0;
+    ReadyBitmap &= ~(0x80000000 >> priority);
+    return;
+  }
+
+  threadPt->readyPrev->readyNext = threadPt->readyNext;
+  threadPt->readyNext->readyPrev = threadPt->readyPrev;
+  if (ReadyHead[priority] == threadPt) {
+    ReadyHead[priority] = threadPt->readyNext;
+  }
+}
+
+// ******** wakeThread ************
+// Makes a blocked or sleeping thread ready to run again.
+// If it should run ahead of RunPt, PendSV is triggered so the switch
+// happens as soon as the caller, thread or ISR, enables interrupts.
+// In tickless mode SysTick may be off, so a thread that will share
+// the processor with RunPt also goes through the scheduler.
+// With EDF a thread due before RunPt at EDFPRIORITY preempts it.
+// Called with interrupts disabled
+// Input: thread that is no longer blocked or sleeping
+// Output: None
+static void wakeThread(tcbType * threadPt) {
+  TRACEEVENT(TRACE_WAKE, threadPt - tcbs, 0);
+  addReadyThread(threadPt);
+#if TICKLESS
+  if (threadPt->priority <= RunPt->priority) { // equal restarts the time slice
+#else
+  if (threadPt->priority < RunPt->priority) {
+#endif
+    INTCTRL = 0x10000000; // trigger PendSV
+  }
+#if EDF
+  if (threadPt->priority == EDFPRIORITY && RunPt->priority == EDFPRIORITY &&
+      ReadyHead[EDFPRIORITY] == threadPt) {
+    INTCTRL = 0x10000000; // trigger PendSV, due first
+  }
+#endif
+}
+
+// ******** startJob ************
+// Starts the next job of a thread with a deadline, due relDeadline
+// cycles from now, if it has ended the last one.  A thread woken in
+// the middle of a job keeps the deadline it had.
+// Called with interrupts disabled, before the thread is made ready
+// Input: thread that is released or woken
+// Output: None
+static void startJob(tcbType * threadPt) {
+  if (threadPt->jobEnded == 0) {
+    return;
+  }
+  threadPt->absDeadline = DWT_CYCCNT + threadPt->relDeadline;
+  threadPt->jobEnded = 0;
+}
+
+// ******** endJob ************
+// Ends the job RunPt was running as it sleeps, waits on a trigger
+// semaphore or calls OS_JobDone, recording how late it was against
+// its deadline
+// Called with interrupts disabled
+// Input: None
+// Output: None
+static void endJob(void) {
+  int32_t lateness;
+
+  if (RunPt->relDeadline == 0 || RunPt->jobEnded) {
+    return;
+  }
+  RunPt->jobEnded = 1;
+  lateness = (int32_t)(DWT_CYCCNT - RunPt->absDeadline);
+  if (lateness > RunPt->worstLateness) {
+    RunPt->worstLateness = lateness;
+  }
+  if (lateness > 0) {
+    RunPt->deadlineMisses++;
+  }
+  RunPt->jobsDone++;
+}
+
+// ******** nextJob ************
+// RunPt ended its job and goes straight on to the next one without
+// waiting, so with EDF it may no longer be the one due first
+// Called with interrupts disabled
+// Input: None
+// Output: None
+static void nextJob(void) {
+  if (RunPt->relDeadline == 0 || RunPt->jobEnded == 0) {
+    return;
+  }
+#if EDF
+  removeReadyThread(RunPt);
+  startJob(RunPt);
+  addReadyThread(RunPt);
+  if (ReadyHead[RunPt->priority] != RunPt) {
+    INTCTRL = 0x10000000; // trigger PendSV
+  }
+#else
+  startJob(RunPt);
+#endif
+}
+
+// ******** chargeRunPt ************
+// Adds the cycles since SwitchCycles to RunPt's run time.
+// Every cycle is charged to one thread, the idle thread
+// included, or to the OS interrupt handlers.
+// Called with interrupts disabled
+// Input: None
+// Output: DWT_CYCCNT now
+static uint32_t chargeRunPt(void) {
+  uint32_t const now = DWT_CYCCNT;
+
+  RunPt->runCycles += now - SwitchCycles;
+  SwitchCycles = now;
+  return now;
+}
+
+// ******** isrEnter ************
+// Called first in every OS interrupt handler, so its time
+// is not charged to the thread it interrupted
+// Input: None
+// Output: None
+static void isrEnter(void) {
+  long const sr = OS_StartCritical();
+
+  TRACEEVENT(TRACE_ISRENTER, RunPt - tcbs, INTCTRL & 0x1FF);
+  if (IsrNesting == 0) {
+    IsrStartCycles = chargeRunPt();
+  }
+  IsrNesting++;
+  OS_EndCritical(sr);
+}
+
+// ******** isrExit ************
+// Called last in every OS interrupt handler
+// Input: None
+// Output: None
+static void isrExit(void) {
+  long const sr = OS_StartCritical();
+
+  TRACEEVENT(TRACE_ISREXIT, RunPt - tcbs, INTCTRL & 0x1FF);
+  IsrNesting--;
+  if (IsrNesting == 0) {
+    SwitchCycles = DWT_CYCCNT;
+    IsrCycles += SwitchCycles - IsrStartCycles;
+  }
+  OS_EndCritical(sr);
+}
+
+// ******** addWaitingThread ************
+// Queues a thread on a semaphore it is about to block on.
+// FIFO semaphores append at the tail; priority semaphores insert
+// behind every waiter of the same or higher priority.
+// Called with interrupts disabled
+// Input: pointer to semaphore
+//        thread that is about to block
+// Output: None
+static void addWaitingThread(Sema4Type * semaPt, tcbType * threadPt) {
+  tcbType ** linkPt;
+
+  if (semaPt->policy == SEMA4_PRIORITY) {
+    linkPt = &semaPt->waitHead;
+    while (*linkPt != 0 && (*linkPt)->priority <= threadPt->priority) {
+      linkPt = &(*linkPt)->waitNext;
+    }
+  } 
+  else if (semaPt->waitHead == 0) {
+    linkPt = &semaPt->waitHead;
+  } 
+  else {
+    linkPt = &semaPt->waitTail->waitNext;
+  }
+
+  threadPt->waitNext = *linkPt;
+  *linkPt = threadPt;
+  if (threadPt->waitNext == 0) {
+    semaPt->waitTail = threadPt;
+  }
+}
+
+// ******** removeWaitingThread ************
+// Unlinks a thread from the queue of a semaphore,
+// which only takes one step for the thread at the head
+// Called with interrupts disabled
+// Input: pointer to semaphore
+//        thread that is blocked on it
 // Output: None
-static void wakeupBlockedThread(int32_t * semaPt) {
-  tcbType * threadPtr = RunPt->next;
+static void removeWaitingThread(Sema4Type * semaPt, tcbType * threadPt) {
+  tcbType ** linkPt = &semaPt->waitHead;
+  tcbType * prevPt = 0;
 
-  while (threadPtr->blocked != semaPt) {
-    threadPtr = threadPtr->next;
+  while (*linkPt != threadPt) {
+    prevPt = *linkPt;
+    linkPt = &prevPt->waitNext;
   }
 
+  *linkPt = threadPt->waitNext;
+  if (semaPt->waitTail == threadPt) {
+    semaPt->waitTail = prevPt;
+  }
+}
+
+// ******** wakeupBlockedThread ************
+// Wakes the thread at the head of the semaphore queue,
+// taking it out of SleepList too if its wait has a time limit
+// Called with interrupts disabled
+// Input: pointer to semaphore that some thread(s) are blocked on
+// Output: None
+static void wakeupBlockedThread(Sema4Type * semaPt) {
+  tcbType * const threadPtr = semaPt->waitHead;
+
+  removeWaitingThread(semaPt, threadPtr);
   threadPtr->blocked = 0;
+  if (threadPtr->sleeping) {
+    removeSleepingThread(threadPtr);
+  }
+  startJob(threadPtr);
+  wakeThread(threadPtr);
 }
 
 // ******** isThreadReady ************
@@ -79,50 +613,170 @@ static void wakeupBlockedThread(int32_t * semaPt) {
 // Input: thread to test
 // Output: None
 static int32_t isThreadReady(tcbType * threadPtr) {
-  return (int32_t)(threadPtr->blocked == 0 && threadPtr->sleepTime == 0);
+  return (int32_t)(threadPtr->blocked == 0 && threadPtr->sleeping == 0);
 }
 
-static void decrementSleepTimer(int32_t const i, int32_t const timeElapsed) {
-  if (tcbs[i].sleepTime >= timeElapsed) {
-    tcbs[i].sleepTime -= timeElapsed;
-  } 
-  else {
-    tcbs[i].sleepTime = 0;
+// ******** addSleepingThread ************
+// Inserts a thread into SleepList, which is kept in wakeup order.
+// Each sleepTime only counts the ms after the thread ahead of it,
+// so the periodic sweep never has to look past the head.
+// Threads with the same wakeup time wake in the order they slept.
+// Called with interrupts disabled
+// Input: thread to put to sleep
+//        ms from OSTime until it wakes up, greater than 0
+// Output: None
+static void addSleepingThread(tcbType * threadPt, uint32_t sleepTime) {
+  tcbType ** linkPt = &SleepList;
+
+  while (*linkPt != 0 && (*linkPt)->sleepTime <= sleepTime) {
+    sleepTime -= (*linkPt)->sleepTime;
+    linkPt = &(*linkPt)->sleepNext;
+  }
+
+  if (*linkPt != 0) {
+    (*linkPt)->sleepTime -= sleepTime;
+  }
+  threadPt->sleepTime = sleepTime;
+  threadPt->sleepNext = *linkPt;
+  threadPt->sleeping = 1;
+  *linkPt = threadPt;
+}
+
+// ******** removeSleepingThread ************
+// Takes a thread out of SleepList before its time is up,
+// handing its sleepTime on to the thread behind it
+// Called with interrupts disabled
+// Input: thread in SleepList
+// Output: None
+static void removeSleepingThread(tcbType * threadPt) {
+  tcbType ** linkPt = &SleepList;
+
+  while (*linkPt != threadPt) {
+    linkPt = &(*linkPt)->sleepNext;
+  }
+
+  *linkPt = threadPt->sleepNext;
+  if (threadPt->sleepNext != 0) {
+    threadPt->sleepNext->sleepTime += threadPt->sleepTime;
   }
+  threadPt->sleepTime = 0;
+  threadPt->sleeping = 0;
 }
 
-#define UPDATE_THREAD_SLEEP_TIMERS_EXECUTIONS_PER_SEC 100
+// ******** advanceSleepList ************
+// Takes elapsed ms off the front of SleepList and
+// wakes every thread whose sleep has run out.  A thread
+// also blocked on a semaphore has timed out, so it gives
+// up its place in the semaphore queue.
+// Called with interrupts disabled
+// Input: ms since the last call
+// Output: None
+static void advanceSleepList(uint32_t timeElapsed) {
+  while (SleepList != 0 && SleepList->sleepTime <= timeElapsed) {
+    tcbType * const threadPt = SleepList;
+
+    timeElapsed -= threadPt->sleepTime;
+    SleepList = threadPt->sleepNext;
+    threadPt->sleepTime = 0;
+    threadPt->sleeping = 0;
+    if (threadPt->blocked != 0) {
+      removeWaitingThread(threadPt->blocked, threadPt);
+      threadPt->blocked->value++;  // one fewer thread blocked on it
+      threadPt->blocked = 0;
+      threadPt->timedOut = 1;
+    }
+    startJob(threadPt);
+    wakeThread(threadPt);
+  }
+
+  if (SleepList != 0) {
+    SleepList->sleepTime -= timeElapsed;
+  }
+}
+
+#if !TICKLESS
+#define UPDATE_THREAD_SLEEP_TIMERS_EXECUTIONS_PER_SEC 1000
 #define MS_PER_SECOND 1000
 static void updateThreadSleepTimers(void) {
-  DisableInterrupts();
+  long sr;
+
+  isrEnter();
+  sr = OS_StartCritical();
   int32_t const timeElapsed = MS_PER_SECOND / UPDATE_THREAD_SLEEP_TIMERS_EXECUTIONS_PER_SEC;
-  for (int i = 0; i < NUMTHREADS; i++) {
-    decrementSleepTimer(i, timeElapsed);
+  OSTime += timeElapsed;
+  advanceSleepList(timeElapsed);
+  TimerWheelTick();       // one tick per ms, like OSTime
+  OS_EndCritical(sr);
+  isrExit();
+}
+#endif
+
+// ******** IdleThread ************
+// Kernel thread that runs when no other thread is ready,
+// sleeping the processor until the next interrupt
+// Inputs:  none
+// Outputs: none
+static void IdleThread(void) {
+  while (1) {
+    WaitForInterrupt();
   }
-  EnableInterrupts();
 }
 
-static void decrementEventTimer(int32_t i, uint32_t timeElapsed) {
-  if (eventThreads[i].timeUntilExecute >= timeElapsed) {
-    eventThreads[i].timeUntilExecute -= timeElapsed;
-  } 
-  else {
-    eventThreads[i].timeUntilExecute = 0;
+// ******** allocStack ************
+// Takes a stack from StackArena.  Threads are never killed,
+// so stacks are handed out in order and never given back.
+// Called with interrupts disabled
+// Input: number of 32-bit words, even so the next stack stays aligned
+// Output: lowest word of the stack, 0 if StackArena is used up
+static int32_t *allocStack(uint32_t stackSize) {
+  int32_t *stack;
+
+  if (stackSize > STACKARENA - StackUsed) {
+    return 0;
   }
+  stack = (int32_t *)StackArena + StackUsed;
+  StackUsed += stackSize;
+  return stack;
 }
 
-#define UPDATE_PERIODIC_EVENT_THREAD_TIMER_FREQ 1000
-static void runPeriodicThreads(void) {
-  int32_t const timeElapsed = MS_PER_SECOND / UPDATE_PERIODIC_EVENT_THREAD_TIMER_FREQ;
-  DisableInterrupts();
-  for (int i = 0; i < NUMPERIODIC; i++) {
-    decrementEventTimer(i, timeElapsed);
-    if (eventThreads[i].timeUntilExecute == 0) {
-      eventThreads[i].thread();
-      eventThreads[i].timeUntilExecute = eventThreads[i].period;
-    }
+// ******** initThread ************
+// Builds the initial stack and TCB of a thread and makes it ready
+// Called with interrupts disabled
+// Input: index of the TCB to use
+//        pointer to the void/void thread function
+//        priority (0 highest)
+//        stack size in 32-bit words
+// Output: 1 if successful, 0 if there is no room for its stack
+static int initThread(int n, void(*thread)(void), uint32_t priority, uint32_t stackSize) {
+  stackSize = (stackSize < STACKMIN) ? STACKMIN : (stackSize + 1) & ~1;
+  tcbs[n].stack = allocStack(stackSize);
+  if (tcbs[n].stack == 0) {
+    return 0;
   }
-  EnableInterrupts();
+  tcbs[n].stackSize = stackSize;
+  tcbs[n].stack[0] = STACKGUARD;
+  for (uint32_t i = 1; i < stackSize; i++) {
+    tcbs[n].stack[i] = STACKFILL;  // OS_StackUsage looks for the first word changed
+  }
+  SetInitialStack(n);
+  tcbs[n].stack[tcbs[n].stackSize-2] = (int32_t)(thread); // PC
+  tcbs[n].usesFPU = 0;
+  tcbs[n].blocked = 0;
+  tcbs[n].sleepTime = 0;
+  tcbs[n].sleeping = 0;
+  tcbs[n].priority = priority;
+  tcbs[n].basePriority = priority;
+  tcbs[n].waitMutex = 0;
+  tcbs[n].heldMutex = 0;
+  tcbs[n].runCycles = 0;
+  tcbs[n].jobsDone = 0;
+  tcbs[n].deadlineMisses = 0;
+  tcbs[n].worstLateness = INT32_MIN;
+  tcbs[n].relDeadline = 0;
+  tcbs[n].jobEnded = 1;
+  tcbs[n].density = 0;
+  addReadyThread(&tcbs[n]);
+  return 1;
 }
 
 // ******** OS_Init ************
@@ -134,74 +788,215 @@ static void runPeriodicThreads(void) {
 void OS_Init(void){
   DisableInterrupts();
   BSP_Clock_InitFastest();// set processor clock to fastest speed
+  NumThread = 0;
+  ReadyBitmap = 0;
+  SleepList = 0;
+  OSTime = 0;
+  WheelTime = 0;
+  StackUsed = 0;
+  IsrNesting = 0;
+  IsrCycles = 0;
+  RealTime = 0;
+  DeadlineDensity = 0;
+  for (int i = 0; i < NUMPRIORITIES; i++) {
+    ReadyHead[i] = 0;
+  }
+  for (int i = 0; i < NUMTRIGGERS; i++) {
+    Triggers[i].semaPt = 0;
+  }
+  DEMCR |= 0x01000000;    // TRCENA, enable the DWT unit
+  DWT_CTRL |= 0x00000001; // CYCCNTENA, start the cycle counter for OS_GetStats
+  initThread(IDLETHREAD, &IdleThread, IDLEPRIORITY, STACKMIN);
+  tcbs[IDLETHREAD].next = &tcbs[0]; // not in the list of main threads, but leads into it
+  RunPt = &tcbs[IDLETHREAD];        // until the first main thread is added
+  tcbs[WORKTHREAD].stack = 0;       // until OS_WorkQueue_Init
+  tcbs[WORKTHREAD].runCycles = 0;
 // perform any initializations needed, 
+#if TICKLESS
+  BSP_Time_Init();        // microsecond time base for one-shot wakeups
+#else
 // set up periodic timer to run runperiodicevents to implement sleeping
   BSP_PeriodicTask_Init(&updateThreadSleepTimers, UPDATE_THREAD_SLEEP_TIMERS_EXECUTIONS_PER_SEC, 2);
-  // BSP_PeriodicTask_InitB(&runPeriodicThreads, UPDATE_PERIODIC_EVENT_THREAD_TIMER_FREQ, 2);
+#endif
 }
 
 
+// The first switch to a thread returns through a basic frame,
+// so it starts without FP context, like any thread before its first
+// floating point instruction.
 void SetInitialStack(int i){
-  tcbs[i].sp = &Stacks[i][STACKSIZE-16]; // thread stack pointer
-  Stacks[i][STACKSIZE-1] = 0x01000000; // Thumb bit
-  Stacks[i][STACKSIZE-3] = 0x14141414; // R14
-  Stacks[i][STACKSIZE-4] = 0x12121212; // R12
-  Stacks[i][STACKSIZE-5] = 0x03030303; // R3
-  Stacks[i][STACKSIZE-6] = 0x02020202; // R2
-  Stacks[i][STACKSIZE-7] = 0x01010101; // R1
-  Stacks[i][STACKSIZE-8] = 0x00000000; // R0
-  Stacks[i][STACKSIZE-9] = 0x11111111; // R11
-  Stacks[i][STACKSIZE-10] = 0x10101010; // R10
-  Stacks[i][STACKSIZE-11] = 0x09090909; // R9
-  Stacks[i][STACKSIZE-12] = 0x08080808; // R8
-  Stacks[i][STACKSIZE-13] = 0x07070707; // R7
-  Stacks[i][STACKSIZE-14] = 0x06060606; // R6
-  Stacks[i][STACKSIZE-15] = 0x05050505; // R5
-  Stacks[i][STACKSIZE-16] = 0x04040404; // R4
- 
+  int32_t *top = &tcbs[i].stack[tcbs[i].stackSize]; // one past the highest word
+  tcbs[i].sp = &top[-17]; // thread stack pointer
+  top[-1] = 0x01000000; // Thumb bit
+  top[-3] = 0x14141414; // R14
+  top[-4] = 0x12121212; // R12
+  top[-5] = 0x03030303; // R3
+  top[-6] = 0x02020202; // R2
+  top[-7] = 0x01010101; // R1
+  top[-8] = 0x00000000; // R0
+  top[-9] = (int32_t)0xFFFFFFF9; // EXC_RETURN, thread mode, basic frame
+  top[-10] = 0x11111111; // R11
+  top[-11] = 0x10101010; // R10
+  top[-12] = 0x09090909; // R9
+  top[-13] = 0x08080808; // R8
+  top[-14] = 0x07070707; // R7
+  top[-15] = 0x06060606; // R6
+  top[-16] = 0x05050505; // R5
+  top[-17] = 0x04040404; // R4
+}
+
+//******** OS_AddThread ***************
+// Add one main thread to the scheduler
+// Inputs: pointer to a void/void main thread
+//         priority (0 highest, IDLEPRIORITY-1 lowest)
+//         stack size in 32-bit words, see STACKMIN
+// Outputs: 1 if successful, 0 if this thread can not be added
+// Called after OS_Init and before OS_Launch
+int OS_AddThread(void(*thread)(void), uint32_t priority, uint32_t stackSize){ long sr;
+  int n;
+
+  if (NumThread == NUMTHREADS || priority >= IDLEPRIORITY) {
+    return 0;
+  }
+
+  sr = OS_StartCritical();
+  n = NumThread;
+  if (initThread(n, thread, priority, stackSize) == 0) {
+    OS_EndCritical(sr);
+    return 0;             // StackArena is used up
+  }
+
+  tcbs[n].next = &tcbs[0]; // circular list of all threads
+  if (n == 0) {
+    RunPt = &tcbs[0];
+  } 
+  else {
+    tcbs[n-1].next = &tcbs[n];
+  }
+
+  NumThread++;
+  OS_EndCritical(sr);
+
+  return 1;               // successful 
 }
 
 //******** OS_AddThreads ***************
 // Add eight main threads to the scheduler
 // Inputs: function pointers to eight void/void main threads
 //         priorites for each main thread (0 highest)
+//         stack sizes for each main thread in 32-bit words
 // Outputs: 1 if successful, 0 if this thread can not be added
 // This function will only be called once, after OS_Init and before OS_Launch
-int OS_AddThreads(void(*thread0)(void), uint32_t p0,
-                  void(*thread1)(void), uint32_t p1,
-                  void(*thread2)(void), uint32_t p2,
-                  void(*thread3)(void), uint32_t p3,
-                  void(*thread4)(void), uint32_t p4,
-                  void(*thread5)(void), uint32_t p5,
-                  void(*thread6)(void), uint32_t p6,
-                  void(*thread7)(void), uint32_t p7){
-  for (int i = 0; i < NUMTHREADS; i++) {
-    initializeThread(i);
-  }
-
-  Stacks[0][STACKSIZE-2] = (int32_t)(thread0); // PC
-  Stacks[1][STACKSIZE-2] = (int32_t)(thread1); // PC
-  Stacks[2][STACKSIZE-2] = (int32_t)(thread2); // PC
-  Stacks[3][STACKSIZE-2] = (int32_t)(thread3); // PC
-  Stacks[4][STACKSIZE-2] = (int32_t)(thread4); // PC
-  Stacks[5][STACKSIZE-2] = (int32_t)(thread5); // PC
-  Stacks[6][STACKSIZE-2] = (int32_t)(thread6); // PC
-  Stacks[7][STACKSIZE-2] = (int32_t)(thread7); // PC
-
-  tcbs[0].priority = p0;
-  tcbs[1].priority = p1;
-  tcbs[2].priority = p2;
-  tcbs[3].priority = p3;
-  tcbs[4].priority = p4;
-  tcbs[5].priority = p5;
-  tcbs[6].priority = p6;
-  tcbs[7].priority = p7;
-
-  RunPt = &tcbs[0];
+int OS_AddThreads(void(*thread0)(void), uint32_t p0, uint32_t s0,
+                  void(*thread1)(void), uint32_t p1, uint32_t s1,
+                  void(*thread2)(void), uint32_t p2, uint32_t s2,
+                  void(*thread3)(void), uint32_t p3, uint32_t s3,
+                  void(*thread4)(void), uint32_t p4, uint32_t s4,
+                  void(*thread5)(void), uint32_t p5, uint32_t s5,
+                  void(*thread6)(void), uint32_t p6, uint32_t s6,
+                  void(*thread7)(void), uint32_t p7, uint32_t s7){
+  return OS_AddThread(thread0, p0, s0) &&
+         OS_AddThread(thread1, p1, s1) &&
+         OS_AddThread(thread2, p2, s2) &&
+         OS_AddThread(thread3, p3, s3) &&
+         OS_AddThread(thread4, p4, s4) &&
+         OS_AddThread(thread5, p5, s5) &&
+         OS_AddThread(thread6, p6, s6) &&
+         OS_AddThread(thread7, p7, s7);
+}
 
-  return 1;               // successful 
+// ******** OS_StackArenaFree ************
+// Number of 32-bit words of stack space not yet given to a thread,
+// what is left over once every thread has been added is RAM
+// that STACKARENA could give up
+// Inputs:  none
+// Outputs: free words in the stack arena
+uint32_t OS_StackArenaFree(void){
+  return STACKARENA - StackUsed;
+}
+
+
+// ******** OS_StackUsage ************
+// Most stack a thread has ever used, found by looking for the lowest
+// word that no longer holds the fill pattern
+// Inputs:  thread number, 0 for the first thread added
+// Outputs: 32-bit words used, 0 if there is no such thread
+uint32_t OS_StackUsage(uint32_t id){
+  uint32_t unused = 0;
+
+  if (id >= NumThread) {
+    return 0;
+  }
+  while ((unused+1 < tcbs[id].stackSize) && (tcbs[id].stack[unused+1] == STACKFILL)) {
+    unused++;
+  }
+  return tcbs[id].stackSize - 1 - unused;   // the guard word is never used
 }
 
+// ******** OS_GetStats ************
+// Share of the CPU each thread, the OS interrupt handlers and the
+// idle thread have had since the previous call, or since OS_Launch,
+// then starts counting again, along with the longest time the
+// kernel kept interrupts masked.  Time is read from the DWT cycle
+// counter on every context switch and OS interrupt, so no single
+// stretch may run longer than 2^32 cycles (53 s at 80 MHz).
+// Inputs:  pointer to the stats to fill in
+// Outputs: none
+void OS_GetStats(OSStatsType *statsPt){ long sr;
+  uint64_t total;
+  uint32_t id;
+
+  sr = OS_StartCritical();
+  chargeRunPt();          // the caller has run until now
+  total = IsrCycles + tcbs[IDLETHREAD].runCycles + tcbs[WORKTHREAD].runCycles;
+  for (id = 0; id < NumThread; id++) {
+    total += tcbs[id].runCycles;
+  }
+  if (total == 0) {
+    total = 1;            // called twice in a row
+  }
+  for (id = 0; id < STATSTHREADS; id++) {
+    statsPt->thread[id] = 0;
+    if (id < NumThread) {
+      statsPt->thread[id] = (uint32_t)((tcbs[id].runCycles*1000)/total);
+    }
+  }
+  statsPt->isr = (uint32_t)((IsrCycles*1000)/total);
+  statsPt->idle = (uint32_t)((tcbs[IDLETHREAD].runCycles*1000)/total);
+  statsPt->work = (uint32_t)((tcbs[WORKTHREAD].runCycles*1000)/total);
+  statsPt->maskedWorst = MaskWorst/(BSP_Clock_GetFreq()/1000000);
+  for (id = 0; id < NumThread; id++) {
+    tcbs[id].runCycles = 0;
+  }
+  tcbs[IDLETHREAD].runCycles = 0;
+  tcbs[WORKTHREAD].runCycles = 0;
+  IsrCycles = 0;
+  MaskWorst = 0;
+  OS_EndCritical(sr);
+}
+
+// ******** OS_GetDeadlines ************
+// Periodic job record of a thread given a deadline by OS_SetDeadline,
+// or released by OS_PeriodTrigger0/1
+// Inputs:  thread number, 0 for the first thread added
+//          pointer to the record to fill in
+// Outputs: 1 if successful, 0 if there is no such thread
+int OS_GetDeadlines(uint32_t id, DeadlineStatsType *statsPt){ long sr;
+  int32_t cyclesPerUs = BSP_Clock_GetFreq()/1000000;
+
+  if (id >= NumThread) {
+    return 0;
+  }
+  sr = OS_StartCritical();
+  statsPt->jobs = tcbs[id].jobsDone;
+  statsPt->misses = tcbs[id].deadlineMisses;
+  statsPt->worstLateness = 0;
+  if (tcbs[id].jobsDone != 0) {
+    statsPt->worstLateness = tcbs[id].worstLateness/cyclesPerUs;
+  }
+  OS_EndCritical(sr);
+  return 1;
+}
 
 void static runperiodicevents(void){
 // ****IMPLEMENT THIS****
@@ -210,6 +1005,55 @@ void static runperiodicevents(void){
   
 }
 
+//******** OS_SetDeadline ***************
+// Gives a main thread periodic jobs with a relative deadline.
+// A job ends when the thread sleeps, waits on a trigger semaphore
+// or calls OS_JobDone, and the next one starts when it wakes up, or
+// at once if that wait does not block.  Other semaphore, mutex and
+// event waits inside a job leave it running.  Each job is checked against
+// its deadline, see OS_GetDeadlines.  With EDF the thread moves to
+// EDFPRIORITY, and ready jobs there run earliest deadline first.
+// The thread is only admitted if the threads with a deadline fit the
+// CPU by density: the sum of wcet/min(deadline,period) is at most 1.
+// That guarantees every deadline with EDF, as long as no job runs
+// longer than its wcet; with fixed priorities it is only a necessary
+// condition.  Interrupt handlers and threads with no deadline are not counted.
+// Inputs: thread number, 0 for the first thread added
+//         period in ms, the shortest time between jobs
+//         deadline in ms from the start of each job, 0 for the period
+//         wcet, worst case execution time of one job in us
+// Outputs: 1 if admitted, 0 if not
+// Called after OS_AddThread and before OS_Launch
+int OS_SetDeadline(uint32_t id, uint32_t period, uint32_t deadline, uint32_t wcet){ long sr;
+  uint32_t density;
+
+  if (deadline == 0) {
+    deadline = period;
+  }
+  if (id >= NumThread || period == 0 || period > MAXDEADLINE || deadline > MAXDEADLINE) {
+    return 0;
+  }
+  density = (uint32_t)(((uint64_t)wcet*1000)/((deadline < period) ? deadline : period));
+  sr = OS_StartCritical();
+  if (DeadlineDensity - tcbs[id].density + density > MAXDENSITY) {
+    OS_EndCritical(sr);
+    return 0;             // could not meet every deadline
+  }
+  DeadlineDensity = DeadlineDensity - tcbs[id].density + density;
+  tcbs[id].density = density;
+  removeReadyThread(&tcbs[id]);
+  tcbs[id].relDeadline = deadline*(BSP_Clock_GetFreq()/1000);
+  tcbs[id].jobEnded = 1;
+  startJob(&tcbs[id]);
+#if EDF
+  tcbs[id].priority = EDFPRIORITY;
+  tcbs[id].basePriority = EDFPRIORITY;
+#endif
+  addReadyThread(&tcbs[id]);
+  OS_EndCritical(sr);
+  return 1;
+}
+
 //******** OS_Launch ***************
 // Start the scheduler, enable interrupts
 // Inputs: number of clock cycles for each time slice
@@ -218,88 +1062,333 @@ void static runperiodicevents(void){
 void OS_Launch(uint32_t theTimeSlice){
   STCTRL = 0;                  // disable SysTick during setup
   STCURRENT = 0;               // any write to current clears it
-  SYSPRI3 =(SYSPRI3&0x00FFFFFF)|0xE0000000; // priority 7
+  SYSPRI3 =(SYSPRI3&0x0000FFFF)|0xE0E00000; // SysTick and PendSV priority 7
   STRELOAD = theTimeSlice - 1; // reload value
   STCTRL = 0x00000007;         // enable, core clock and interrupt arm
+#if TICKLESS
+  ticklessStart();             // one-shot wakeups instead of the sleep sweep
+#endif
+  SwitchCycles = DWT_CYCCNT;   // CPU usage is counted from here
+  for (uint32_t id = 0; id < NumThread; id++) {
+    if (tcbs[id].relDeadline != 0) {
+      removeReadyThread(&tcbs[id]); // first jobs are released now
+      tcbs[id].jobEnded = 1;
+      startJob(&tcbs[id]);
+      addReadyThread(&tcbs[id]);
+    }
+  }
+  Scheduler();                 // first task is the highest priority ready thread
   StartOS();                   // start on the first task
 }
 
+// runs in PendSV_Handler
+// The highest priority with a ready thread is the number of leading zeros
+// in ReadyBitmap, so a switch costs the same no matter how many threads exist.
+// ReadyHead only moves on at the end of a time slice, so a thread that
+// was preempted carries on where it left off.
+// The idle thread is always ready, so ReadyBitmap is never 0.
+// usesFPU records whether PendSV_Handler just saved FP registers
+// for the thread being switched out.
+// In tickless mode SysTick only counts time slices while another
+// thread shares the chosen priority.
+// A thread whose stack guard word was overwritten has already
+// corrupted the stack below it, so the OS stops with
+// StackOverflowPt showing which one.
+// The thread switched out is charged for the time it ran.
+void Scheduler(void){      // every context switch
+  uint32_t const priority = __builtin_clz(ReadyBitmap); // CLZ instruction
+
+  chargeRunPt();
+  if ((RunPt->stack[0] != STACKGUARD) || (RunPt->sp < RunPt->stack)) {
+    StackOverflowPt = RunPt;
+    while (1) {};          // stack overflow, look at StackOverflowPt
+  }
+  RunPt->usesFPU = ((RunPt->sp[EXCRETURN]&0x10) == 0); // extended frame saved
+  TRACEEVENT(TRACE_SWITCH, ReadyHead[priority] - tcbs, RunPt - tcbs);
+  RunPt = ReadyHead[priority];
+#if TICKLESS
+  if (RunPt->readyNext == RunPt || (EDF && priority == EDFPRIORITY)) {
+    STCTRL = 0x00000006;       // alone at this priority or run by deadline, stop the time slice
+  } 
+  else {
+    STCURRENT = 0;             // any write to current clears it
+    STCTRL = 0x00000007;       // enable, core clock and interrupt arm
+  }
+#endif
+}
+
+#if LINEARSCAN
 #define LOWEST_PRIORITY 255
-// runs every ms
-void Scheduler(void){      // every time slice
-  // ****IMPLEMENT THIS****
-  // look at all threads in TCB list choose
-  // highest priority thread not blocked and not sleeping 
-  // If there are multiple highest priority (not blocked, not sleeping) run these round robin
+// ******** SchedulerLinearScan ************
+// Original Lab 4 scheduler: walk the whole TCB list for the highest
+// priority thread not blocked and not sleeping, round robin among equals.
+// Kept only as the reference for the Step 7 benchmark in Lab4.c
+// The walk stops after NumThread threads, since the idle and work
+// threads lead into the ring but are not part of it.
+// Called with interrupts disabled
+// Input: None
+// Output: None
+void SchedulerLinearScan(void){
   tcbType * threadPt = RunPt;
-  tcbType * highestPriorityThread;
+  tcbType * highestPriorityThread = RunPt;
   uint32_t highestPriorityLevel = LOWEST_PRIORITY;
 
-  do {
+  for (uint32_t n = 0; n < NumThread; n++) {
     threadPt = threadPt->next;
     if (isThreadReady(threadPt) && threadPt->priority < highestPriorityLevel) {
       highestPriorityThread = threadPt;
       highestPriorityLevel = highestPriorityThread->priority;
     }
-  } while (threadPt != RunPt);
+  }
 
   RunPt = highestPriorityThread;
 }
+#endif
+
+// ******** sleepRunningThread ************
+// Moves RunPt from its ready list to SleepList
+// Called with interrupts disabled, the caller then suspends
+// Input: ms from OSTime until it wakes up, greater than 0
+// Output: None
+static void sleepRunningThread(uint32_t sleepTime) {
+  removeReadyThread(RunPt);
+  addSleepingThread(RunPt, sleepTime);
+#if TICKLESS
+  startWakeupTimer();     // this may now be the earliest deadline
+#endif
+}
+
+// ******** endTimeSlice ************
+// Moves RunPt to the back of the ready list for its priority,
+// so the next thread there gets a turn
+// Does nothing if RunPt has just blocked or gone to sleep, or with
+// EDF if it is at EDFPRIORITY, where the order is set by deadlines
+// Called with interrupts disabled
+// Input: None
+// Output: None
+static void endTimeSlice(void) {
+#if EDF
+  if (RunPt->priority == EDFPRIORITY) {
+    return;
+  }
+#endif
+  if (ReadyHead[RunPt->priority] == RunPt) {
+    ReadyHead[RunPt->priority] = RunPt->readyNext;
+  }
+}
+
+// ******** SysTick_Handler ************
+// End of a time slice, round robin among threads of the same priority.
+// The switch itself is left to PendSV, and skipped if RunPt is alone
+// at its priority.
+// Inputs:  none
+// Outputs: none
+void SysTick_Handler(void){ long sr;
+  isrEnter();
+  sr = OS_StartCritical();
+  endTimeSlice();
+  if (ReadyHead[RunPt->priority] != RunPt) {
+    INTCTRL = 0x10000000; // trigger PendSV
+  }
+  OS_EndCritical(sr);
+  isrExit();
+}
 
 //******** OS_Suspend ***************
 // Called by main thread to cooperatively suspend operation
 // Inputs: none
 // Outputs: none
 // Will be run again depending on sleep/block status
-void OS_Suspend(void){
+void OS_Suspend(void){ long sr;
+  sr = OS_StartCritical();
+  endTimeSlice();
   STCURRENT = 0;        // any write to current clears it
-  INTCTRL = 0x04000000; // trigger SysTick
+  INTCTRL = 0x10000000; // trigger PendSV
+  OS_EndCritical(sr);
 // next thread gets a full time slice
 }
 
 // ******** OS_Sleep ************
 // place this thread into a dormant state
-// input:  number of msec to sleep
+// input:  number of msec to sleep, 1 ms resolution
 // output: none
 // OS_Sleep(0) implements cooperative multitasking
-void OS_Sleep(uint32_t sleepTime){
-// ****IMPLEMENT THIS****
-// set sleep parameter in TCB, same as Lab 3
-// suspend, stops running
-  DisableInterrupts();
-  RunPt->sleepTime = sleepTime;
-  EnableInterrupts();
+void OS_Sleep(uint32_t sleepTime){ long sr;
+  sr = OS_StartCritical();
+#if TICKLESS
+  advanceOSTime();        // count sleepTime from now, like the other sleepers
+#endif
+  if (sleepTime) {
+    endJob();
+    sleepRunningThread(sleepTime);
+  }
+  OS_EndCritical(sr);
+  OS_Suspend();
+}
+
+// ******** OS_SleepUntil ************
+// place this thread into a dormant state until an absolute time,
+// so a loop that adds its period to wakeTime does not drift
+// input:  OS_MsTime() value to wake up at
+// output: none
+// a wakeTime that has already passed behaves like OS_Sleep(0)
+void OS_SleepUntil(uint32_t wakeTime){ long sr;
+  sr = OS_StartCritical();
+#if TICKLESS
+  advanceOSTime();
+#endif
+  endJob();
+  if ((int32_t)(wakeTime - OSTime) > 0) { // signed difference handles roll over
+    sleepRunningThread(wakeTime - OSTime);
+  } 
+  else {
+    nextJob();            // already behind, the next job is released now
+  }
+  OS_EndCritical(sr);
   OS_Suspend();
+}
+
+// ******** OS_JobDone ************
+// ends the current job of a thread given a deadline by OS_SetDeadline,
+// for one that waits for its next job on a semaphore or event that is
+// not a trigger; the next job starts when the thread next wakes up,
+// or at once if its next wait does not block
+// input:  none
+// output: none
+void OS_JobDone(void){ long sr;
+  sr = OS_StartCritical();
+  endJob();
+  OS_EndCritical(sr);
+}
 
+// ******** OS_MsTime ************
+// reads the time since OS_Launch
+// Inputs:  none
+// Outputs: time in ms, rolls over after 49 days
+uint32_t OS_MsTime(void){
+#if TICKLESS
+  long sr = OS_StartCritical();
+  advanceOSTime();        // OSTime is only brought up to date on demand
+  OS_EndCritical(sr);
+#endif
+  return OSTime;
 }
 
 // ******** OS_InitSemaphore ************
-// Initialize counting semaphore
+// Initialize counting semaphore, blocked threads wake in FIFO order
 // Inputs:  pointer to a semaphore
 //          initial value of semaphore
 // Outputs: none
-void OS_InitSemaphore(int32_t *semaPt, int32_t value){
-// ****IMPLEMENT THIS****
-  *semaPt = value;
- 
+void OS_InitSemaphore(Sema4Type *semaPt, int32_t value){
+  OS_InitSemaphorePolicy(semaPt, value, SEMA4_FIFO);
 }
 
-// ******** OS_Wait ************
+// ******** OS_InitSemaphorePolicy ************
+// Initialize counting semaphore with a choice of wake order
+// Inputs:  pointer to a semaphore
+//          initial value of semaphore
+//          SEMA4_FIFO or SEMA4_PRIORITY
+// Outputs: none
+void OS_InitSemaphorePolicy(Sema4Type *semaPt, int32_t value, uint32_t policy){
+  semaPt->value = value;
+  semaPt->policy = policy;
+  semaPt->waitHead = 0;
+  semaPt->waitTail = 0;
+}
+
+//****LDREX/STREX fast paths************
+// A free semaphore or mutex is taken, and one with nothing blocked on
+// it given, by an exclusive load and store of its count or owner,
+// leaving interrupts enabled.  Exception entry and return clear the
+// exclusive monitor, so the store fails, and the load is repeated,
+// if anything ran in between.  Anything that blocks or wakes a
+// thread goes through the kernel with interrupts disabled.
+#if FASTSEMA4
+// ******** endsJob ************
+// Tests whether waiting on a semaphore has job accounting to do,
+// because the semaphore is a periodic trigger or RunPt has ended
+// its job and the next one starts here
+// Input: pointer to a semaphore
+// Output: 1 if the wait has to go through the kernel, 0 if not
+static int endsJob(Sema4Type * semaPt) {
+  if (RunPt->relDeadline != 0 && RunPt->jobEnded) {
+    return 1;
+  }
+  for (uint32_t n = 0; n < NUMTRIGGERS; n++) {
+    if (Triggers[n].semaPt == semaPt) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// ******** takeFast ************
+// Decrements a semaphore that is above zero
+// Input: pointer to a semaphore
+// Output: 1 if taken, 0 if it was not above zero
+static int takeFast(Sema4Type * semaPt) {
+  int32_t value;
+
+  do {
+    value = LDREX(&semaPt->value);
+    if (value <= 0) {
+      CLREX();
+      return 0;
+    }
+  } while (STREX(value - 1, &semaPt->value));
+
+  return 1;
+}
+
+// ******** giveFast ************
+// Increments a semaphore no thread is blocked on
+// Input: pointer to a semaphore
+// Output: 1 if given, 0 if a thread has to be woken
+static int giveFast(Sema4Type * semaPt) {
+  int32_t value;
+
+  do {
+    value = LDREX(&semaPt->value);
+    if (value < 0) {
+      CLREX();
+      return 0;
+    }
+  } while (STREX(value + 1, &semaPt->value));
+
+  return 1;
+}
+#endif
+
+// ******** OS_Wait ************
 // Decrement semaphore and block if less than zero
 // Lab2 spinlock (does not suspend while spinning)
 // Lab3 block if less than zero
 // Inputs:  pointer to a counting semaphore
 // Outputs: none
-void OS_Wait(int32_t *semaPt){
-  DisableInterrupts();
-  (*semaPt)--;
+void OS_Wait(Sema4Type *semaPt){
+  long sr;
 
-  if (*semaPt < 0) {
+  TRACEEVENT(TRACE_WAIT, traceContext(), TRACESEMA(semaPt));
+#if FASTSEMA4
+  if (!endsJob(semaPt) && takeFast(semaPt)) {
+    return;
+  }
+#endif
+  sr = OS_StartCritical();
+  finishJob(semaPt);
+  semaPt->value--;
+
+  if (semaPt->value < 0) {
     RunPt->blocked = semaPt;
-    OS_Suspend();
+    removeReadyThread(RunPt);
+    addWaitingThread(semaPt, RunPt);
+    OS_Suspend();         // the next job starts when it is signalled
+  } 
+  else {
+    nextJob();
   }
 
-  EnableInterrupts();
+  OS_EndCritical(sr);
 }
 
 // ******** OS_Signal ************
@@ -308,48 +1397,625 @@ void OS_Wait(int32_t *semaPt){
 // Lab3 wakeup blocked thread if appropriate
 // Inputs:  pointer to a counting semaphore
 // Outputs: none
-void OS_Signal(int32_t *semaPt){
-  DisableInterrupts();
-  (*semaPt)++;
+void OS_Signal(Sema4Type *semaPt){
+  long sr;
 
-  if (*semaPt <= 0) {
+  TRACEEVENT(TRACE_SIGNAL, traceContext(), TRACESEMA(semaPt));
+#if FASTSEMA4
+  if (giveFast(semaPt)) {
+    return;
+  }
+#endif
+  sr = OS_StartCritical();
+  semaPt->value++;
+
+  if (semaPt->value <= 0) {
     wakeupBlockedThread(semaPt);
   } 
 
-  EnableInterrupts();
+  OS_EndCritical(sr);
 }
 
-#define FSIZE 10    // can be any size
-uint32_t PutI;      // index of where to put next
-uint32_t GetI;      // index of where to get next
-uint32_t Fifo[FSIZE];
-int32_t CurrentSize;// 0 means FIFO empty, FSIZE means full
-uint32_t LostData;  // number of lost pieces of data
+#if LINEARSCAN
+// ******** OS_SignalLinearScan ************
+// Original Lab 4 OS_Signal: walk the TCB ring from RunPt for a thread
+// blocked on this semaphore, so the cost grows with the number of
+// threads and the wake order follows ring position.
+// Kept only as the reference for the Step 8 benchmark in Lab4.c
+// The walk stops after NumThread threads; a waiter outside the ring,
+// the work thread, is taken from the head of the queue instead.
+// Inputs:  pointer to a counting semaphore
+// Outputs: none
+void OS_SignalLinearScan(Sema4Type *semaPt){
+  tcbType * threadPtr;
+  uint32_t n;
+  long sr;
+
+  sr = OS_StartCritical();
+  semaPt->value++;
+
+  if (semaPt->value <= 0) {
+    threadPtr = RunPt->next;
+    for (n = 0; n < NumThread && threadPtr->blocked != semaPt; n++) {
+      threadPtr = threadPtr->next;
+    }
+    if (threadPtr->blocked != semaPt) {
+      threadPtr = semaPt->waitHead;
+    }
+    removeWaitingThread(semaPt, threadPtr); // keep the queue consistent
+    threadPtr->blocked = 0;
+    if (threadPtr->sleeping) {
+      removeSleepingThread(threadPtr);
+    }
+    startJob(threadPtr);
+    wakeThread(threadPtr);
+  } 
+
+  OS_EndCritical(sr);
+}
+#endif
+
+// ******** waitSemaphore ************
+// OS_Wait with a time limit.  A thread that has to block is also
+// put in SleepList, and whichever of the signal or the timeout
+// comes first takes it out of the other list.
+// A timeout of 0 only polls, so it may be called from an ISR,
+// and leaves the job accounting of the interrupted thread alone.
+// Input: pointer to a counting semaphore
+//        ms to wait, 0 to poll, WAIT_FOREVER for no limit
+// Output: 1 if the semaphore was taken, 0 if the time ran out
+static int waitSemaphore(Sema4Type * semaPt, uint32_t timeout) {
+  long sr;
+  int taken = 0;
 
-// ******** incrementFifoIndex ************
-// Increments and wraps a Fifo indexer, i.e. PutI and GetI
-// Input: the index to increment
+  TRACEEVENT(TRACE_WAIT, traceContext(), TRACESEMA(semaPt));
+#if FASTSEMA4
+  if ((timeout == 0 || !endsJob(semaPt)) && takeFast(semaPt)) {
+    return 1;
+  }
+#endif
+  sr = OS_StartCritical();
+
+  if (timeout == 0) {
+    if (semaPt->value > 0) {
+      semaPt->value--;
+      taken = 1;
+    }
+    OS_EndCritical(sr);
+    return taken;
+  }
+
+  finishJob(semaPt);
+  semaPt->value--;
+
+  if (semaPt->value >= 0) {
+    nextJob();
+    OS_EndCritical(sr);
+    return 1;
+  }
+
+  RunPt->blocked = semaPt;
+  RunPt->timedOut = 0;
+  removeReadyThread(RunPt);
+  addWaitingThread(semaPt, RunPt);
+  if (timeout != WAIT_FOREVER) {
+#if TICKLESS
+    advanceOSTime();      // count the timeout from now
+#endif
+    addSleepingThread(RunPt, timeout);
+#if TICKLESS
+    startWakeupTimer();
+#endif
+  }
+  OS_Suspend();
+  OS_EndCritical(sr);        // runs again once signalled or timed out
+
+  return !RunPt->timedOut;
+}
+
+// ******** signalSemaphore ************
+// OS_Signal for callers that already have interrupts disabled
+// Input: pointer to a counting semaphore
 // Output: None
-static void incrementFifoIndex(uint32_t * index) {
-  if (*index == FSIZE-1) {
-    *index = 0;
+static void signalSemaphore(Sema4Type * semaPt) {
+  TRACEEVENT(TRACE_SIGNAL, traceContext(), TRACESEMA(semaPt));
+  semaPt->value++;
+
+  if (semaPt->value <= 0) {
+    wakeupBlockedThread(semaPt);
+  }
+}
+
+// ******** OS_WaitTimeout ************
+// OS_Wait that gives up after timeout ms.  The thread sleeps and
+// is blocked at the same time, so no one has to poll for it.
+// Inputs:  pointer to a counting semaphore
+//          ms to wait, 0 to not wait, WAIT_FOREVER for no limit
+// Outputs: 1 if the semaphore was taken, 0 if the time ran out
+int OS_WaitTimeout(Sema4Type *semaPt, uint32_t timeout){
+  return waitSemaphore(semaPt, timeout);
+}
+
+//****mutexes with priority inheritance************
+// ******** setThreadPriority ************
+// Changes the current priority of a thread, moving it to the
+// matching ready list, or to its new place in a priority semaphore
+// queue, so later decisions see the new priority
+// Called with interrupts disabled
+// Input: thread to change
+//        new priority
+// Output: None
+static void setThreadPriority(tcbType * threadPt, uint32_t priority) {
+  if (threadPt->priority == priority) {
+    return;               // keep its place in line
+  }
+
+  if (threadPt->blocked != 0 && threadPt->blocked->policy == SEMA4_PRIORITY) {
+    removeWaitingThread(threadPt->blocked, threadPt);
+    threadPt->priority = priority;
+    addWaitingThread(threadPt->blocked, threadPt);
+  } 
+  else if (isThreadReady(threadPt)) {
+    removeReadyThread(threadPt);
+    threadPt->priority = priority;
+    addReadyThread(threadPt);
   } 
   else {
-    (*index)++;
+    threadPt->priority = priority; // sleeping or in a FIFO queue
+  }
+}
+
+// ******** inheritPriority ************
+// Raises the owner of a mutex to the priority of a thread blocking on it,
+// and passes the raise along if that owner is itself blocked on a mutex
+// Called with interrupts disabled
+// Input: mutex the thread is blocking on
+//        priority of the blocking thread
+// Output: None
+static void inheritPriority(MutexType * mutexPt, uint32_t priority) {
+  tcbType * ownerPt = mutexPt->owner;
+
+  while (ownerPt->priority > priority) {
+    setThreadPriority(ownerPt, priority);
+    if (ownerPt->waitMutex == 0) {
+      return;
+    }
+    ownerPt = ownerPt->waitMutex->owner;
   }
 }
 
+// ******** inheritedPriority ************
+// Finds the priority a thread should run at: its own, or that of
+// the highest priority thread blocked on a mutex it owns
+// Called with interrupts disabled
+// Input: thread to check
+// Output: priority (0 highest)
+static uint32_t inheritedPriority(tcbType * threadPt) {
+  uint32_t priority = threadPt->basePriority;
+  MutexType * mutexPt;
+
+  for (mutexPt = threadPt->heldMutex; mutexPt != 0; mutexPt = mutexPt->heldNext) {
+    if (mutexPt->queue.waitHead != 0 && mutexPt->queue.waitHead->priority < priority) {
+      priority = mutexPt->queue.waitHead->priority;
+    }
+  }
+
+  return priority;
+}
+
+// ******** giveMutex ************
+// Makes a thread the owner of a mutex
+// Called with interrupts disabled
+// Input: mutex that is free
+//        thread that now owns it
+// Output: None
+static void giveMutex(MutexType * mutexPt, tcbType * threadPt) {
+  mutexPt->owner = threadPt;
+  mutexPt->heldNext = threadPt->heldMutex;
+  threadPt->heldMutex = mutexPt;
+}
+
+// ******** unlinkMutex ************
+// Removes a mutex from the list its owner holds, leaving the owner set
+// Called with interrupts disabled, or by the owner itself, since
+// the kernel only changes the list of a thread that is blocked
+// Input: mutex that is owned
+// Output: None
+static void unlinkMutex(MutexType * mutexPt) {
+  MutexType ** linkPt = &mutexPt->owner->heldMutex;
+
+  while (*linkPt != mutexPt) {
+    linkPt = &(*linkPt)->heldNext;
+  }
+
+  *linkPt = mutexPt->heldNext;
+}
+
+// ******** takeMutex ************
+// Removes a mutex from the list its owner holds
+// Called with interrupts disabled
+// Input: mutex that is owned
+// Output: None
+static void takeMutex(MutexType * mutexPt) {
+  unlinkMutex(mutexPt);
+  mutexPt->owner = 0;
+}
+
+#if FASTSEMA4
+// ******** lockFast ************
+// Makes RunPt the owner of a free mutex.  A thread that blocks on it
+// before RunPt has added it to its list only raises RunPt's priority,
+// which does not need the list.
+// Input: pointer to a mutex
+// Output: 1 if locked, 0 if it is owned
+static int lockFast(MutexType * mutexPt) {
+  do {
+    if (LDREX(&mutexPt->owner) != 0) {
+      CLREX();
+      return 0;
+    }
+  } while (STREX(RunPt, &mutexPt->owner));
+
+  mutexPt->heldNext = RunPt->heldMutex;
+  RunPt->heldMutex = mutexPt;
+  return 1;
+}
+
+// ******** unlockFast ************
+// Frees a mutex RunPt owns that no thread is blocked on.  With no
+// thread blocked on it, it was not raising RunPt's priority.
+// Input: pointer to a mutex
+// Output: 1 if unlocked, 0 if a thread has to be handed the mutex
+static int unlockFast(MutexType * mutexPt) {
+  if (mutexPt->owner != RunPt || mutexPt->queue.waitHead != 0) {
+    return 0;
+  }
+
+  unlinkMutex(mutexPt);
+  do {
+    (void)LDREX(&mutexPt->owner);
+    if (mutexPt->queue.waitHead != 0) { // a thread blocked after the check
+      CLREX();
+      giveMutex(mutexPt, RunPt);        // back on the list for the kernel
+      return 0;
+    }
+  } while (STREX(0, &mutexPt->owner));
+
+  return 1;
+}
+#endif
+
+// ******** OS_InitMutex ************
+// Initialize a mutex as free
+// Inputs:  pointer to a mutex
+// Outputs: none
+void OS_InitMutex(MutexType *mutexPt){
+  OS_InitSemaphorePolicy(&mutexPt->queue, 0, SEMA4_PRIORITY);
+  mutexPt->owner = 0;
+  mutexPt->heldNext = 0;
+}
+
+// ******** OS_MutexLock ************
+// Take the mutex, blocking while another thread owns it.
+// The owner inherits the priority of the threads it blocks.
+// Only main threads may lock, never event threads or ISRs.
+// Inputs:  pointer to a mutex
+// Outputs: 1 if successful, 0 if this thread already owns it
+int OS_MutexLock(MutexType *mutexPt){
+  long sr;
+
+#if FASTSEMA4
+  if (lockFast(mutexPt)) {
+    return 1;
+  }
+#endif
+  sr = OS_StartCritical();
+
+  if (mutexPt->owner == RunPt) {
+    OS_EndCritical(sr);
+    return 0;             // locking again would deadlock
+  }
+
+  if (mutexPt->owner == 0) {
+    giveMutex(mutexPt, RunPt);
+  } 
+  else {
+    RunPt->blocked = &mutexPt->queue;
+    RunPt->waitMutex = mutexPt;
+    removeReadyThread(RunPt);
+    addWaitingThread(&mutexPt->queue, RunPt);
+    inheritPriority(mutexPt, RunPt->priority);
+    OS_Suspend();         // OS_MutexUnlock hands over the mutex
+  }
+
+  OS_EndCritical(sr);
+  return 1;
+}
+
+// ******** OS_MutexUnlock ************
+// Release the mutex, handing it to the highest priority blocked thread,
+// and drop back to the priority the thread had before it inherited
+// Inputs:  pointer to a mutex
+// Outputs: 1 if successful, 0 if this thread does not own it
+int OS_MutexUnlock(MutexType *mutexPt){
+  tcbType * threadPt;
+  long sr;
+
+#if FASTSEMA4
+  if (unlockFast(mutexPt)) {
+    return 1;
+  }
+#endif
+  sr = OS_StartCritical();
+
+  if (mutexPt->owner != RunPt) {
+    OS_EndCritical(sr);
+    return 0;
+  }
+
+  takeMutex(mutexPt);
+  setThreadPriority(RunPt, inheritedPriority(RunPt));
+  threadPt = mutexPt->queue.waitHead;
+  if (threadPt != 0) {
+    removeWaitingThread(&mutexPt->queue, threadPt);
+    threadPt->blocked = 0;
+    threadPt->waitMutex = 0;
+    giveMutex(mutexPt, threadPt);
+    threadPt->priority = inheritedPriority(threadPt); // the rest of the queue
+    wakeThread(threadPt);
+  }
+  if (__builtin_clz(ReadyBitmap) < RunPt->priority) {
+    INTCTRL = 0x10000000; // trigger PendSV, no longer the highest priority
+  }
+
+  OS_EndCritical(sr);
+  return 1;
+}
+
+//****message queues************
+// Each queue copies fixed-size messages through a buffer the caller
+// supplies.  items counts messages waiting and spaces counts free
+// slots, so senders block on spaces and receivers on items.
+// Indexes run freely, depth need not be a power of two.
+
+// ******** OS_QueueInit ************
+// Initialize an empty message queue
+// Inputs:  pointer to a queue
+//          buffer of at least size*depth bytes
+//          bytes per message
+//          number of messages it can hold
+// Outputs: none
+void OS_QueueInit(QueueType *queuePt, void *buffer, uint32_t size, uint32_t depth){
+  queuePt->buffer = (uint8_t *)buffer;
+  queuePt->size = size;
+  queuePt->depth = depth;
+  queuePt->putI = 0;
+  queuePt->getI = 0;
+  queuePt->lost = 0;
+  OS_InitSemaphore(&queuePt->items, 0);
+  OS_InitSemaphore(&queuePt->spaces, depth);
+}
+
+// ******** slotPt ************
+// Finds where a message goes in the queue buffer
+// Input: pointer to a queue
+//        free-running index
+// Output: address of its slot
+static uint8_t *slotPt(QueueType * queuePt, uint32_t index) {
+  return &queuePt->buffer[(index % queuePt->depth) * queuePt->size];
+}
+
+// ******** OS_QueueSendBurst ************
+// Copy up to count messages into a queue.  Waits for a free slot
+// only for the first one, then sends as many more as fit right away,
+// so a producer with a burst of data does it in one pass.
+// Timeout 0 never blocks and may be called from an ISR.
+// Inputs:  pointer to a queue
+//          array of count messages
+//          number of messages to send
+//          ms to wait for space, 0 to not wait, WAIT_FOREVER for no limit
+// Outputs: number of messages sent, the rest are counted in lost
+//          only if the queue stayed full for the whole timeout
+uint32_t OS_QueueSendBurst(QueueType *queuePt, const void *msgs, uint32_t count, uint32_t timeout){
+  const uint8_t *msgPt = (const uint8_t *)msgs;
+  uint32_t sent, extra;
+  long sr;
+
+  if (count == 0) {
+    return 0;
+  }
+  if (!waitSemaphore(&queuePt->spaces, timeout)) {
+    sr = OS_StartCritical();  // ISRs may send to this queue too
+    queuePt->lost += count;
+    OS_EndCritical(sr);
+    return 0;
+  }
+
+  sr = OS_StartCritical();
+  extra = count - 1;      // one slot is already ours
+  if (queuePt->spaces.value < (int32_t)extra) {
+    extra = queuePt->spaces.value > 0 ? queuePt->spaces.value : 0;
+  }
+  queuePt->spaces.value -= extra;
+  for (sent = 0; sent <= extra; sent++) {
+    memcpy(slotPt(queuePt, queuePt->putI), msgPt, queuePt->size);
+    queuePt->putI++;
+    msgPt += queuePt->size;
+    signalSemaphore(&queuePt->items);
+  }
+  OS_EndCritical(sr);
+
+  return sent;
+}
+
+// ******** OS_QueueRecvBurst ************
+// Copy up to count messages out of a queue.  Waits only for the
+// first one, then takes whatever else is already waiting.
+// Timeout 0 never blocks and may be called from an ISR.
+// Inputs:  pointer to a queue
+//          array with room for count messages
+//          most messages to receive
+//          ms to wait for a message, 0 to not wait, WAIT_FOREVER for no limit
+// Outputs: number of messages received, 0 if the time ran out
+uint32_t OS_QueueRecvBurst(QueueType *queuePt, void *msgs, uint32_t count, uint32_t timeout){
+  uint8_t *msgPt = (uint8_t *)msgs;
+  uint32_t received, extra;
+  long sr;
+
+  if (count == 0) {
+    return 0;
+  }
+  if (!waitSemaphore(&queuePt->items, timeout)) {
+    return 0;
+  }
+
+  sr = OS_StartCritical();
+  extra = count - 1;
+  if (queuePt->items.value < (int32_t)extra) {
+    extra = queuePt->items.value > 0 ? queuePt->items.value : 0;
+  }
+  queuePt->items.value -= extra;
+  for (received = 0; received <= extra; received++) {
+    memcpy(msgPt, slotPt(queuePt, queuePt->getI), queuePt->size);
+    queuePt->getI++;
+    msgPt += queuePt->size;
+    signalSemaphore(&queuePt->spaces);
+  }
+  OS_EndCritical(sr);
+
+  return received;
+}
+
+// ******** OS_QueueSend ************
+// Copy one message into a queue
+// Inputs:  pointer to a queue
+//          message of the queue's size
+//          ms to wait for space, 0 to not wait, WAIT_FOREVER for no limit
+// Outputs: 1 if sent, 0 if the queue stayed full
+int OS_QueueSend(QueueType *queuePt, const void *msg, uint32_t timeout){
+  return OS_QueueSendBurst(queuePt, msg, 1, timeout);
+}
+
+// ******** OS_QueueRecv ************
+// Copy one message out of a queue
+// Inputs:  pointer to a queue
+//          room for a message of the queue's size
+//          ms to wait for a message, 0 to not wait, WAIT_FOREVER for no limit
+// Outputs: 1 if received, 0 if the queue stayed empty
+int OS_QueueRecv(QueueType *queuePt, void *msg, uint32_t timeout){
+  return OS_QueueRecvBurst(queuePt, msg, 1, timeout);
+}
+
+//****lock-free rings************
+// A ring has one producer, usually an ISR, and one consumer thread.
+// Only the producer writes putI and only the consumer writes getI,
+// and each is a single aligned word store, so neither side needs a
+// critical section.  The barriers keep a slot's data and its index
+// in order.  Indexes run freely and are masked.  The consumer is
+// signalled once, when the ring fills to threshold, not per word.
+
+// ******** OS_RingInit ************
+// Initialize an empty ring
+// Inputs:  pointer to a ring
+//          buffer of size words
+//          size, a power of 2
+//          words it has to hold before the consumer is woken, 1 to size
+// Outputs: 1 if successful, 0 if size or threshold is not allowed
+int OS_RingInit(RingType *ringPt, uint32_t *buffer, uint32_t size, uint32_t threshold){
+  if ((size == 0) || (size & (size - 1)) || (threshold == 0) || (threshold > size)) {
+    return 0;
+  }
+  ringPt->buffer = buffer;
+  ringPt->mask = size - 1;
+  ringPt->putI = 0;
+  ringPt->getI = 0;
+  ringPt->threshold = threshold;
+  ringPt->lost = 0;
+  OS_InitSemaphore(&ringPt->ready, 0);
+  return 1;
+}
+
+// ******** OS_RingPut ************
+// Add a word to a ring, only ever called by its producer.
+// Disables interrupts only to signal the consumer, when
+// this word brings the ring up to its threshold.
+// Inputs:  pointer to a ring
+//          data to be stored
+// Outputs: 1 if successful, 0 if the ring is full
+int OS_RingPut(RingType *ringPt, uint32_t data){
+  uint32_t const putI = ringPt->putI;
+  long sr;
+
+  if (putI - ringPt->getI > ringPt->mask) {
+    ringPt->lost++;
+    return 0;             // full
+  }
+
+  ringPt->buffer[putI & ringPt->mask] = data;
+  MEMORYBARRIER();        // the data is in the ring before the consumer sees it
+  ringPt->putI = putI + 1;
+
+  if (putI + 1 - ringPt->getI == ringPt->threshold) {
+    sr = OS_StartCritical();
+    signalSemaphore(&ringPt->ready);
+    OS_EndCritical(sr);
+  }
+
+  return 1;
+}
+
+// ******** OS_RingGet ************
+// Take a word from a ring, only ever called by its consumer.
+// Never blocks, see OS_RingWait.
+// Inputs:  pointer to a ring
+//          place to store the word
+// Outputs: 1 if successful, 0 if the ring is empty
+int OS_RingGet(RingType *ringPt, uint32_t *dataPt){
+  uint32_t const getI = ringPt->getI;
+
+  if (ringPt->putI == getI) {
+    return 0;             // empty
+  }
+
+  MEMORYBARRIER();        // read the data only after seeing putI
+  *dataPt = ringPt->buffer[getI & ringPt->mask];
+  MEMORYBARRIER();        // done with the slot before the producer can reuse it
+  ringPt->getI = getI + 1;
+
+  return 1;
+}
+
+// ******** OS_RingWait ************
+// Block the consumer until its ring holds threshold words.
+// The semaphore may hold a signal for words already taken,
+// so the count is checked again after every wake.
+// Inputs:  pointer to a ring
+//          ms to wait, 0 to not wait, WAIT_FOREVER for no limit
+// Outputs: number of words in the ring, below threshold if the time ran out
+uint32_t OS_RingWait(RingType *ringPt, uint32_t timeout){
+  while (ringPt->putI - ringPt->getI < ringPt->threshold) {
+    if (!waitSemaphore(&ringPt->ready, timeout)) {
+      break;
+    }
+  }
+
+  return ringPt->putI - ringPt->getI;
+}
+
+//****the original single FIFO, now one message queue************
+#define FSIZE 10    // can be any size
+uint32_t Fifo[FSIZE];
+QueueType FifoQueue;
+uint32_t LostData;  // number of lost pieces of data
+
 // ******** OS_FIFO_Init ************
 // Initialize FIFO.  
 // One event thread producer, one main thread consumer
 // Inputs:  none
 // Outputs: none
 void OS_FIFO_Init(void){
-  PutI = Fifo[0];
-  GetI = Fifo[0];
+  OS_QueueInit(&FifoQueue, Fifo, sizeof(uint32_t), FSIZE);
   LostData = 0;
-
-  OS_InitSemaphore(&CurrentSize, 0);
 }
 
 
@@ -360,15 +2026,11 @@ void OS_FIFO_Init(void){
 // Inputs:  data to be stored
 // Outputs: 0 if successful, -1 if the FIFO is full
 int OS_FIFO_Put(uint32_t data){
-  if (CurrentSize == FSIZE) {
+  if (!OS_QueueSend(&FifoQueue, &data, 0)) {
     LostData++;
     return -1; // full
   }
 
-  Fifo[PutI] = data;
-  incrementFifoIndex(&PutI);
-  OS_Signal(&CurrentSize);
-
   return 0;   // success
 }
 
@@ -381,69 +2043,768 @@ int OS_FIFO_Put(uint32_t data){
 uint32_t OS_FIFO_Get(void){
   uint32_t data;
 
-  OS_Wait(&CurrentSize);
-  data = Fifo[GetI];
-  incrementFifoIndex(&GetI);
+  OS_QueueRecv(&FifoQueue, &data, WAIT_FOREVER);
+
+  return data;
+}
+
+// ******** OS_FIFO_GetTimeout ************
+// Get an entry from the FIFO, giving up after timeout ms
+// Inputs:  place to store the entry
+//          ms to wait, 0 to not wait, WAIT_FOREVER for no limit
+// Outputs: 1 if successful, 0 if the FIFO stayed empty
+int OS_FIFO_GetTimeout(uint32_t *dataPt, uint32_t timeout){
+  return OS_QueueRecv(&FifoQueue, dataPt, timeout);
+}
+
+//****mailbox************
+uint32_t MailData;
+QueueType MailBox;  // a queue one message deep
+uint32_t LostMail;  // number of messages sent while it was full
+
+// ******** OS_MailBox_Init ************
+// Initialize communication channel
+// Producer is an event thread, consumer is a main thread
+// Inputs:  none
+// Outputs: none
+void OS_MailBox_Init(void){
+  OS_QueueInit(&MailBox, &MailData, sizeof(uint32_t), 1);
+  LostMail = 0;
+}
+
+// ******** OS_MailBox_Send ************
+// Enter data into the MailBox, do not spin/block if full
+// Inputs:  data to be sent
+// Outputs: none
+// Errors: data lost if MailBox already has data
+void OS_MailBox_Send(uint32_t data){
+  if (!OS_QueueSend(&MailBox, &data, 0)) {
+    LostMail++;
+  }
+}
+
+// ******** OS_MailBox_Recv ************
+// retreive mail from the MailBox
+// block on semaphore if mailbox empty
+// Inputs:  none
+// Outputs: data retreived
+uint32_t OS_MailBox_Recv(void){
+  uint32_t data;
+
+  OS_QueueRecv(&MailBox, &data, WAIT_FOREVER);
 
   return data;
 }
 
+// ******** OS_MailBox_RecvTimeout ************
+// retreive mail from the MailBox, giving up after timeout ms
+// Inputs:  place to store the mail
+//          ms to wait, 0 to not wait, WAIT_FOREVER for no limit
+// Outputs: 1 if successful, 0 if no mail came
+int OS_MailBox_RecvTimeout(uint32_t *dataPt, uint32_t timeout){
+  return OS_QueueRecv(&MailBox, dataPt, timeout);
+}
+
+//****deferred interrupt work************
+// An interrupt handler keeps to the urgent part of its job and posts
+// the rest as a work item, a function and a 32-bit argument.  The
+// kernel work thread runs the items in the order they were posted,
+// with interrupts enabled, so they may take longer, block or sleep
+// without holding up other interrupts.  Indexes run freely and are
+// masked, so the queue is full when they are WORKSIZE apart.
+typedef struct{
+  void (*work)(uint32_t);  // function to run in the work thread
+  uint32_t data;           // its argument
+} WorkType;
+WorkType WorkQueue[WORKSIZE];
+uint32_t WorkPutI;         // items posted
+uint32_t WorkGetI;         // items taken by the work thread
+Sema4Type WorkReady;       // items in WorkQueue
+uint32_t LostWork;         // items not posted because WorkQueue was full
+
+// ******** postWork ************
+// Adds a work item to WorkQueue and wakes the work thread
+// Called with interrupts disabled
+// Input: function to run and its argument
+// Output: 1 if successful, 0 if WorkQueue is full
+static int postWork(void(*work)(uint32_t), uint32_t data) {
+  if (tcbs[WORKTHREAD].stack == 0 || WorkPutI - WorkGetI == WORKSIZE) {
+    LostWork++;
+    return 0;
+  }
+  WorkQueue[WorkPutI & (WORKSIZE-1)].work = work;
+  WorkQueue[WorkPutI & (WORKSIZE-1)].data = data;
+  WorkPutI++;
+  WorkReady.value++;       // OS_Signal would enable interrupts
+  if (WorkReady.value <= 0) {
+    wakeupBlockedThread(&WorkReady);
+  }
+  return 1;
+}
+
+// ******** WorkThread ************
+// Kernel thread that runs posted work items one at a time
+// Inputs:  none
+// Outputs: none
+static void WorkThread(void) {
+  WorkType item;
+  long sr;
+
+  while (1) {
+    OS_Wait(&WorkReady);
+    sr = OS_StartCritical();
+    item = WorkQueue[WorkGetI & (WORKSIZE-1)];
+    WorkGetI++;            // only now can the slot be posted to again
+    OS_EndCritical(sr);
+    item.work(item.data);
+  }
+}
+
+// ******** OS_WorkQueue_Init ************
+// Create the kernel work thread that runs items from OS_WorkPost
+// Inputs:  priority (0 highest), usually above the threads that
+//          wait on what the work items produce
+//          stack size in 32-bit words, for the deepest work item
+// Outputs: 1 if successful, 0 if there is no room for its stack
+// Called after OS_Init and before OS_Launch
+int OS_WorkQueue_Init(uint32_t priority, uint32_t stackSize){ long sr;
+  if (priority >= IDLEPRIORITY || tcbs[WORKTHREAD].stack != 0) {
+    return 0;
+  }
+  sr = OS_StartCritical();
+  WorkPutI = 0;
+  WorkGetI = 0;
+  LostWork = 0;
+  OS_InitSemaphore(&WorkReady, 0);
+  if (initThread(WORKTHREAD, &WorkThread, priority, stackSize) == 0) {
+    tcbs[WORKTHREAD].stack = 0;
+    OS_EndCritical(sr);
+    return 0;
+  }
+  tcbs[WORKTHREAD].next = &tcbs[0]; // like the idle thread, not a main thread
+  OS_EndCritical(sr);
+  return 1;
+}
+
+// ******** OS_WorkPost ************
+// Queue a function for the work thread to run.  Can be called from
+// interrupt handlers, event threads and timer callbacks, as well
+// as main threads.
+// Inputs:  function to run, void/uint32_t
+//          argument to pass it
+// Outputs: 1 if successful, 0 if the queue was full and the item lost
+int OS_WorkPost(void(*work)(uint32_t), uint32_t data){
+  long const sr = OS_StartCritical();
+  int const posted = postWork(work, data);
+
+  OS_EndCritical(sr);
+  return posted;
+}
+
 // *****periodic events****************
-int32_t *PeriodicSemaphore0;
-uint32_t Period0; // time between signals
-int32_t *PeriodicSemaphore1;
-uint32_t Period1; // time between signals
-void RealTimeEvents(void){int flag=0;
-  static int32_t realCount = -10; // let all the threads execute once
-  // Note to students: we had to let the system run for a time so all user threads ran at least one
-  // before signalling the periodic tasks
-  realCount++;
-  if(realCount >= 0){
-		if((realCount%Period0)==0){
-      OS_Signal(PeriodicSemaphore0);
-      flag = 1;
-		}
-    if((realCount%Period1)==0){
-      OS_Signal(PeriodicSemaphore1);
-      flag=1;
-		}
-    if(flag){
-      OS_Suspend();
+// Each trigger releases a job, one signal of its semaphore, at the
+// absolute times PERIODICSTART + k*period ms.  Release times never
+// depend on when the last job ran, so a late interrupt or a long job
+// does not push later releases back.  The job finishes when the thread
+// running it waits on the semaphore again; its deadline is the next
+// release.  This replaces checking the jitter offline with TExaS.
+
+// ******** releaseJobs ************
+// Signals each trigger semaphore once for every release time that
+// has come.  A release that finds the previous job still running
+// is a deadline miss for the thread running it.
+// Called from the periodic interrupt handler
+// Input: ms time now, RealTime or OSTime
+// Output: None
+static void releaseJobs(uint32_t now) {
+  for (uint32_t n = 0; n < NUMTRIGGERS; n++) {
+    TriggerType * const trigPt = &Triggers[n];
+
+    while (trigPt->semaPt && (int32_t)(now - trigPt->nextRelease) >= 0) {
+      if (trigPt->jobs == 0) {
+        trigPt->releaseCycles = DWT_CYCCNT;
+      }
+      else if (trigPt->threadPt && trigPt->threadPt->relDeadline == 0) {
+        trigPt->threadPt->deadlineMisses++;
+      }
+      trigPt->jobs++;
+      trigPt->nextRelease += trigPt->period;
+      TRACEEVENT(TRACE_RELEASE, trigPt->threadPt ? trigPt->threadPt - tcbs : TRACEISR, n);
+      OS_Signal(trigPt->semaPt);
     }
   }
 }
+
+// ******** finishJob ************
+// Called as a thread waits on a semaphore.  If it is a trigger
+// semaphore with a job out, the thread has finished the oldest one,
+// so its lateness, time from the deadline to now, is recorded.
+// A thread given its own deadline by OS_SetDeadline ends its job
+// here too, but is judged by endJob instead.
+// Called with interrupts disabled
+// Input: semaphore RunPt is about to wait on
+// Output: None
+static void finishJob(Sema4Type * semaPt) {
+  for (uint32_t n = 0; n < NUMTRIGGERS; n++) {
+    TriggerType * const trigPt = &Triggers[n];
+
+    if (trigPt->semaPt != semaPt) {
+      continue;
+    }
+    trigPt->threadPt = RunPt;
+    endJob();
+    if (trigPt->jobs != 0) {
+      int32_t const lateness = (int32_t)(DWT_CYCCNT - trigPt->releaseCycles - trigPt->periodCycles);
+
+      if (RunPt->relDeadline == 0) {
+        if (lateness > RunPt->worstLateness) {
+          RunPt->worstLateness = lateness;
+        }
+        RunPt->jobsDone++;
+      }
+      trigPt->jobs--;
+      trigPt->releaseCycles += trigPt->periodCycles; // next job was released one period later
+    }
+  }
+}
+
+// OS_Signal triggers PendSV if the thread it wakes should preempt,
+// so there is no need to suspend the interrupted thread here
+void RealTimeEvents(void){
+  isrEnter();
+  RealTime++;
+  releaseJobs(RealTime);
+  isrExit();
+}
+
+//****event groups************
+// A thread waiting on an event group sits in its queue like a
+// semaphore waiter, so priority changes and EDF jobs work the same.
+// Setting flags walks the whole queue, since any waiter, not only
+// the first, may now be satisfied.
+
+// ******** eventsReady ************
+// Tests whether a wait on an event group is satisfied
+// Input: flags set
+//        flags waited for
+//        EVENT_ANY or EVENT_ALL, and EVENT_CLEAR
+// Output: 1 if the thread can go on, 0 if not
+static int eventsReady(uint32_t flags, uint32_t mask, uint32_t options) {
+  if (options & EVENT_ALL) {
+    return (flags & mask) == mask;
+  }
+  return (flags & mask) != 0;
+}
+
+// ******** OS_InitEventGroup ************
+// Initialize an event group with every flag clear
+// Inputs:  pointer to an event group
+// Outputs: none
+void OS_InitEventGroup(EventGroupType *groupPt){
+  groupPt->flags = 0;
+  OS_InitSemaphorePolicy(&groupPt->queue, 0, SEMA4_PRIORITY);
+}
+
+// ******** OS_EventWait ************
+// Block until any, or all, of the flags in a mask are set.
+// It does not end the current job of a thread with a deadline.
+// Inputs:  pointer to an event group
+//          flags to wait for, not 0
+//          EVENT_ANY or EVENT_ALL, or'ed with EVENT_CLEAR to consume them
+// Outputs: the flags in the mask that were set when it woke
+uint32_t OS_EventWait(EventGroupType *groupPt, uint32_t mask, uint32_t options){
+  uint32_t flags;
+  long sr;
+
+  sr = OS_StartCritical();
+  if (eventsReady(groupPt->flags, mask, options)) {
+    flags = groupPt->flags & mask;
+    if (options & EVENT_CLEAR) {
+      groupPt->flags &= ~mask;
+    }
+    nextJob();
+    OS_EndCritical(sr);
+    return flags;
+  }
+
+  RunPt->eventMask = mask;
+  RunPt->eventOptions = options;
+  RunPt->blocked = &groupPt->queue;
+  removeReadyThread(RunPt);
+  addWaitingThread(&groupPt->queue, RunPt);
+  OS_Suspend();           // OS_EventSet fills in eventFlags
+  OS_EndCritical(sr);
+  return RunPt->eventFlags;
+}
+
+// ******** OS_EventSet ************
+// Set flags, waking every thread whose wait they complete, highest
+// priority first.  A waiter that clears flags on the way out takes
+// them before the lower priority waiters behind it are checked.
+// Can be called from interrupt handlers.
+// Inputs:  pointer to an event group
+//          flags to set
+// Outputs: none
+void OS_EventSet(EventGroupType *groupPt, uint32_t flags){
+  long const sr = OS_StartCritical();
+  tcbType ** linkPt = &groupPt->queue.waitHead;
+  tcbType * prevPt = 0;
+  tcbType * threadPt;
+
+  groupPt->flags |= flags;
+  while ((threadPt = *linkPt) != 0) {
+    if (!eventsReady(groupPt->flags, threadPt->eventMask, threadPt->eventOptions)) {
+      prevPt = threadPt;
+      linkPt = &threadPt->waitNext;
+      continue;
+    }
+    *linkPt = threadPt->waitNext;   // unlink, linkPt now points at the next waiter
+    if (groupPt->queue.waitTail == threadPt) {
+      groupPt->queue.waitTail = prevPt;
+    }
+    threadPt->eventFlags = groupPt->flags & threadPt->eventMask;
+    if (threadPt->eventOptions & EVENT_CLEAR) {
+      groupPt->flags &= ~threadPt->eventMask;
+    }
+    threadPt->blocked = 0;
+    startJob(threadPt);
+    wakeThread(threadPt);
+  }
+  OS_EndCritical(sr);
+}
+
+// ******** OS_EventClear ************
+// Clear flags.  Can be called from interrupt handlers.
+// Inputs:  pointer to an event group
+//          flags to clear
+// Outputs: none
+void OS_EventClear(EventGroupType *groupPt, uint32_t flags){
+  long const sr = OS_StartCritical();
+
+  groupPt->flags &= ~flags;
+  OS_EndCritical(sr);
+}
+
+// ******** OS_EventGet ************
+// Read the flags without waiting
+// Inputs:  pointer to an event group
+// Outputs: the flags that are set
+uint32_t OS_EventGet(EventGroupType *groupPt){
+  return groupPt->flags;
+}
+
+//****timer wheel************
+// Software timers for periodic and one-shot callbacks, 1 ms to about
+// 9 hours.  Level L of the wheel holds the timers due in less than
+// 32^(L+1) ms, in the slot given by bits 5L to 5L+4 of their expiry
+// time.  Each ms TimerWheelTick runs the level 0 slot for that ms;
+// every 32 ms it first moves the timers in the next level 1 slot
+// down, every 1024 ms those in the next level 2 slot, and so on.
+// Starting, stopping and expiring a timer take the same time however
+// many timers there are, and a timer moves down at most 4 times.
+#define WHEELBITS   5
+#define WHEELSLOTS  (1<<WHEELBITS)   // slots per level
+#define WHEELLEVELS 5                // 32^5 ms is 9.3 hours
+#define TIMERMAX    ((1<<(WHEELBITS*WHEELLEVELS))-1) // longest delay or period in ms
+TimerType *Wheel[WHEELLEVELS][WHEELSLOTS]; // timers in each slot, 0 if none
+uint32_t WheelBitmap[WHEELLEVELS];   // bit (31-slot) is set if the slot has a timer
+
+// ******** linkTimer ************
+// Puts a timer in the wheel slot for its expiry time
+// Called with interrupts disabled
+// Input: timer with expires no more than TIMERMAX after WheelTime
+// Output: None
+static void linkTimer(TimerType * timerPt) {
+  uint32_t const delta = timerPt->expires - WheelTime;
+  uint32_t const level = (delta == 0) ? 0 : (31 - __builtin_clz(delta))/WHEELBITS;
+  uint32_t const slot = (timerPt->expires >> (WHEELBITS*level)) & (WHEELSLOTS-1);
+
+  timerPt->slot = &Wheel[level][slot];
+  timerPt->prev = 0;
+  timerPt->next = Wheel[level][slot];
+  if (timerPt->next != 0) {
+    timerPt->next->prev = timerPt;
+  }
+  Wheel[level][slot] = timerPt;
+  WheelBitmap[level] |= (0x80000000 >> slot);
+}
+
+// ******** unlinkTimer ************
+// Takes a running timer out of its wheel slot
+// Called with interrupts disabled
+// Input: timer that is in the wheel
+// Output: None
+static void unlinkTimer(TimerType * timerPt) {
+  uint32_t const index = timerPt->slot - &Wheel[0][0];
+
+  if (timerPt->prev != 0) {
+    timerPt->prev->next = timerPt->next;
+  }
+  else {
+    *timerPt->slot = timerPt->next;
+    if (timerPt->next == 0) {
+      WheelBitmap[index/WHEELSLOTS] &= ~(0x80000000 >> (index%WHEELSLOTS));
+    }
+  }
+  if (timerPt->next != 0) {
+    timerPt->next->prev = timerPt->prev;
+  }
+  timerPt->slot = 0;
+}
+
+// ******** cascadeTimers ************
+// Moves the timers in the current slot of a higher level down,
+// now that they are due within that level's span
+// Called with interrupts disabled
+// Input: level 1 to WHEELLEVELS-1
+// Output: None
+static void cascadeTimers(uint32_t level) {
+  uint32_t const slot = (WheelTime >> (WHEELBITS*level)) & (WHEELSLOTS-1);
+  TimerType * timerPt = Wheel[level][slot];
+  TimerType * nextPt;
+
+  Wheel[level][slot] = 0;
+  WheelBitmap[level] &= ~(0x80000000 >> slot);
+  while (timerPt != 0) {
+    nextPt = timerPt->next;
+    linkTimer(timerPt);
+    timerPt = nextPt;
+  }
+}
+
+// ******** TimerWheelTick ************
+// Advances the wheel by 1 ms and runs the callbacks that are due.
+// A periodic timer goes back in the wheel before its callback runs,
+// due one period after it was due this time, so it does not drift.
+// Runs in the 1 kHz sleep timer, or in the Wide Timer2A wakeup
+// in tickless mode, with interrupts disabled
+// Input: None
+// Output: None
+void TimerWheelTick(void) {
+  uint32_t slot;
+  TimerType * timerPt;
+
+  WheelTime++;
+  for (uint32_t level = 1; level < WHEELLEVELS; level++) {
+    if ((WheelTime & ((1 << (WHEELBITS*level)) - 1)) != 0) {
+      break;
+    }
+    cascadeTimers(level);
+  }
+
+  slot = WheelTime & (WHEELSLOTS-1);
+  while ((timerPt = Wheel[0][slot]) != 0) {
+    unlinkTimer(timerPt);
+    if (timerPt->period != 0) {
+      timerPt->expires += timerPt->period;
+      linkTimer(timerPt);
+    }
+    if (timerPt->work != 0) {
+      postWork(timerPt->work, timerPt->data);
+    } 
+    else {
+      timerPt->callback();  // may stop or restart any timer
+    }
+  }
+}
+
+// ******** OS_InitTimer ************
+// Initialize a software timer as stopped
+// Inputs:  pointer to a timer
+//          function to call when it expires
+// Outputs: none
+void OS_InitTimer(TimerType *timerPt, void(*callback)(void)){
+  timerPt->callback = callback;
+  timerPt->work = 0;
+  timerPt->slot = 0;
+}
+
+// ******** OS_InitWorkTimer ************
+// Initialize a software timer as stopped, that posts a work item
+// when it expires instead of calling a function in the interrupt
+// Inputs:  pointer to a timer
+//          function for the work thread to run
+//          argument to pass it
+// Outputs: none
+void OS_InitWorkTimer(TimerType *timerPt, void(*work)(uint32_t), uint32_t data){
+  timerPt->callback = 0;
+  timerPt->work = work;
+  timerPt->data = data;
+  timerPt->slot = 0;
+}
+
+// ******** OS_TimerStart ************
+// (Re)start a software timer
+// Inputs:  pointer to a timer
+//          ms until the first callback, 1 to TIMERMAX
+//          ms between callbacks after that, 0 for a one-shot timer
+// Outputs: 1 if successful, 0 if the delay or period is too long
+int OS_TimerStart(TimerType *timerPt, uint32_t delay, uint32_t period){ long sr;
+  if (delay > TIMERMAX || period > TIMERMAX) {
+    return 0;
+  }
+  if (delay == 0) {
+    delay = 1;            // the earliest a callback can run is the next tick
+  }
+
+  sr = OS_StartCritical();
+  if (timerPt->slot != 0) {
+    unlinkTimer(timerPt);
+  }
+  timerPt->period = period;
+  timerPt->expires = WheelTime + delay;
+  linkTimer(timerPt);
+#if TICKLESS
+  NVIC_PEND3_R = 1<<2;    // run the Wide Timer2A handler, it may be the earliest deadline
+#endif
+  OS_EndCritical(sr);
+  return 1;
+}
+
+// ******** OS_TimerStop ************
+// Stop a software timer, its callback will not run again
+// until OS_TimerStart
+// Inputs:  pointer to a timer
+// Outputs: none
+void OS_TimerStop(TimerType *timerPt){ long sr;
+  sr = OS_StartCritical();
+  if (timerPt->slot != 0) {
+    unlinkTimer(timerPt);
+  }
+  OS_EndCritical(sr);
+}
+
+#if TICKLESS
+//****tickless time base************
+// There is no periodic interrupt: OSTime only advances when the kernel
+// reads BSP_Time_Get(), on a Wide Timer2A wakeup, in OS_Sleep or in OS_MsTime.
+// Wide Timer2A runs one-shot in 1 us units and is always set for the
+// earliest sleep expiry or periodic release, so with every thread
+// blocked or sleeping the idle thread stays in WFI until real work is due.
+#define MAXWAKEUP 60000      // longest one-shot in ms, well inside the 71 minute BSP_Time_Get range
+uint32_t LastTimeUs;         // BSP_Time_Get() when OSTime was last advanced
+uint32_t PendingUs;          // us since LastTimeUs not yet counted in OSTime
+
+// ******** advanceOSTime ************
+// Adds the whole ms since the last call to OSTime and
+// takes them off SleepList
+// Called with interrupts disabled
+// Input: None
+// Output: None
+static void advanceOSTime(void) {
+  uint32_t const now = BSP_Time_Get();
+  uint32_t elapsedMs;
+
+  PendingUs += now - LastTimeUs; // unsigned math handles roll over
+  LastTimeUs = now;
+  elapsedMs = PendingUs/1000;
+  if (elapsedMs == 0) {
+    return;
+  }
+
+  PendingUs -= elapsedMs*1000;
+  OSTime += elapsedMs;
+  advanceSleepList(elapsedMs);
+}
+
+// ******** timeUntilRelease ************
+// ms from OSTime to a periodic release, 0 if it is already due
+// Input: OSTime of the release
+// Output: ms to wait
+static uint32_t timeUntilRelease(uint32_t releaseTime) {
+  if ((int32_t)(releaseTime - OSTime) <= 0) {
+    return 0;
+  }
+
+  return releaseTime - OSTime;
+}
+
+// ******** timeUntilTimer ************
+// ms from OSTime to the next tick with work for the timer wheel: a
+// level 0 slot with timers, or the start of the next level 0 turn
+// if timers are waiting in a higher level
+// Input: None
+// Output: ms to wait, MAXWAKEUP if no timer is running
+static uint32_t timeUntilTimer(void) {
+  uint32_t const now = WheelTime & (WHEELSLOTS-1);
+  uint32_t const turn = (now + 1) & (WHEELSLOTS-1);
+  uint32_t bits = WheelBitmap[0];
+  uint32_t ahead = MAXWAKEUP;   // ms after WheelTime
+
+  if (bits != 0) {              // rotate so slot now+1 is bit 31
+    bits = (turn == 0) ? bits : (bits << turn) | (bits >> (32 - turn));
+    ahead = __builtin_clz(bits) + 1;
+  }
+  for (uint32_t level = 1; level < WHEELLEVELS; level++) {
+    if (WheelBitmap[level] != 0 && (WHEELSLOTS - now) < ahead) {
+      ahead = WHEELSLOTS - now;
+    }
+  }
+  if (ahead == MAXWAKEUP) {
+    return MAXWAKEUP;
+  }
+  return timeUntilRelease(WheelTime + ahead);
+}
+
+// ******** runTimerWheel ************
+// Catches the timer wheel up with OSTime
+// Called from the Wide Timer2A handler, after advanceOSTime
+// Input: None
+// Output: None
+static void runTimerWheel(void) {
+  long const sr = OS_StartCritical(); // callbacks run with interrupts disabled
+  uint32_t timers = 0;
+
+  for (uint32_t level = 0; level < WHEELLEVELS; level++) {
+    timers |= WheelBitmap[level];
+  }
+  if (timers == 0) {
+    WheelTime = OSTime;   // nothing to run, skip the empty ticks
+  }
+  while ((int32_t)(OSTime - WheelTime) > 0) {
+    TimerWheelTick();
+  }
+  OS_EndCritical(sr);
+}
+
+// ******** startWakeupTimer ************
+// Programs Wide Timer2A for the earliest sleep expiry, periodic release
+// or software timer
+// Called with interrupts disabled, after advanceOSTime
+// Input: None
+// Output: None
+static void startWakeupTimer(void) {
+  uint32_t wakeMs = MAXWAKEUP;
+  uint32_t wakeUs;
+
+  if (SleepList != 0 && SleepList->sleepTime < wakeMs) {
+    wakeMs = SleepList->sleepTime;
+  }
+  for (uint32_t n = 0; n < NUMTRIGGERS; n++) {
+    if (Triggers[n].semaPt && timeUntilRelease(Triggers[n].nextRelease) < wakeMs) {
+      wakeMs = timeUntilRelease(Triggers[n].nextRelease);
+    }
+  }
+  if (timeUntilTimer() < wakeMs) {
+    wakeMs = timeUntilTimer();
+  }
+
+  wakeUs = wakeMs*1000;
+  if (wakeUs > PendingUs) {
+    wakeUs = wakeUs - PendingUs; // the timer fires one count later, after the ms boundary
+  } 
+  else {
+    wakeUs = 1;                  // already due
+  }
+  WTIMER2_CTL_R &= ~TIMER_CTL_TAEN;// disable Wide Timer2A during setup
+  WTIMER2_TAILR_R = wakeUs;        // one-shot count
+  WTIMER2_CTL_R |= TIMER_CTL_TAEN; // start counting
+}
+
+// ******** wakeupTimerInit ************
+// Initialize Wide Timer2A as the one-shot kernel wakeup
+// at priority 2, the same as the periodic sleep sweep it replaces
+// Inputs:  none
+// Outputs: none
+static void wakeupTimerInit(void) {
+  SYSCTL_RCGCWTIMER_R |= 0x04;     // activate clock for Wide Timer2
+  while((SYSCTL_PRWTIMER_R&0x04) == 0){};// allow time for clock to stabilize
+  WTIMER2_CTL_R &= ~TIMER_CTL_TAEN;// disable Wide Timer2A during setup
+  WTIMER2_CFG_R = TIMER_CFG_16_BIT;// configure for 32-bit timer mode
+  WTIMER2_TAMR_R = TIMER_TAMR_TAMR_1_SHOT; // one-shot, default down-count settings
+  WTIMER2_TAPR_R = 79;             // 1 us resolution
+  WTIMER2_ICR_R = TIMER_ICR_TATOCINT;// clear WTIMER2A timeout flag
+  WTIMER2_IMR_R |= TIMER_IMR_TATOIM;// arm timeout interrupt
+// Bits 23:21 Interrupt [4n+2], n=24 => (4n+2)=98
+  NVIC_PRI24_R = (NVIC_PRI24_R&0xFF00FFFF)|(2<<21); // priority 2
+// vector number 114, interrupt number 98
+// 32 bits in each NVIC_ENx_R register, 98/32 = 3 remainder 2
+  NVIC_EN3_R = 1<<2;               // enable IRQ 98 in NVIC
+}
+
+// ******** ticklessStart ************
+// Starts OSTime at 0 and arms the first wakeup
+// Called from OS_Launch with interrupts disabled
+// Inputs:  none
+// Outputs: none
+static void ticklessStart(void) {
+  OSTime = 0;
+  WheelTime = 0;
+  LastTimeUs = BSP_Time_Get();
+  PendingUs = 0;
+  wakeupTimerInit();
+  startWakeupTimer();
+}
+
+void WideTimer2A_Handler(void){
+  isrEnter();
+  WTIMER2_ICR_R = TIMER_ICR_TATOCINT;// acknowledge Wide Timer2A timeout
+  advanceOSTime();                 // wake threads whose sleep has expired
+  releaseJobs(OSTime);             // tickless replacement for RealTimeEvents
+  runTimerWheel();
+  startWakeupTimer();
+  isrExit();
+}
+#endif
+
+// ******** initTrigger ************
+// Sets up a trigger to release its first job PERIODICSTART ms from now
+// Input: trigger number, 0 or 1
+//        semaphore to signal
+//        period in ms
+// Output: None
+static void initTrigger(uint32_t n, Sema4Type *semaPt, uint32_t period) {
+  TriggerType * const trigPt = &Triggers[n];
+
+  trigPt->period = period;
+  trigPt->periodCycles = (BSP_Clock_GetFreq()/1000)*period;
+  trigPt->jobs = 0;
+  trigPt->threadPt = 0;
+#if TICKLESS
+  trigPt->nextRelease = OSTime + PERIODICSTART;
+#else
+  trigPt->nextRelease = RealTime + PERIODICSTART;
+#endif
+  trigPt->semaPt = semaPt;  // last, the handler skips it until now
+}
+
 // ******** OS_PeriodTrigger0_Init ************
 // Initialize periodic timer interrupt to signal 
 // Inputs:  semaphore to signal
 //          period in ms
-// priority level at 0 (highest
+// priority level KERNELPRIORITY, the highest that may call the OS
 // Outputs: none
-void OS_PeriodTrigger0_Init(int32_t *semaPt, uint32_t period){
-	PeriodicSemaphore0 = semaPt;
-	Period0 = period;
-	BSP_PeriodicTask_InitC(&RealTimeEvents,1000,0);
+void OS_PeriodTrigger0_Init(Sema4Type *semaPt, uint32_t period){
+  initTrigger(0, semaPt, period);
+#if !TICKLESS
+	BSP_PeriodicTask_InitC(&RealTimeEvents,1000,KERNELPRIORITY);
+#endif
 }
 // ******** OS_PeriodTrigger1_Init ************
 // Initialize periodic timer interrupt to signal 
 // Inputs:  semaphore to signal
 //          period in ms
-// priority level at 0 (highest
+// priority level KERNELPRIORITY, the highest that may call the OS
 // Outputs: none
-void OS_PeriodTrigger1_Init(int32_t *semaPt, uint32_t period){
-	PeriodicSemaphore1 = semaPt;
-	Period1 = period;
-	BSP_PeriodicTask_InitC(&RealTimeEvents,1000,0);
+void OS_PeriodTrigger1_Init(Sema4Type *semaPt, uint32_t period){
+  initTrigger(1, semaPt, period);
+#if !TICKLESS
+	BSP_PeriodicTask_InitC(&RealTimeEvents,1000,KERNELPRIORITY);
+#endif
 }
 
 //****edge-triggered event************
-int32_t *edgeSemaphore;
+Sema4Type *edgeSemaphore;
 // ******** OS_EdgeTrigger_Init ************
 // Initialize button1, PD6, to signal on a falling edge interrupt
 // Inputs:  semaphore to signal
-//          priority
+//          priority, raised to KERNELPRIORITY since it calls the OS
 // Outputs: none
-void OS_EdgeTrigger_Init(int32_t *semaPt, uint8_t priority) {
+void OS_EdgeTrigger_Init(Sema4Type *semaPt, uint8_t priority) {
 	edgeSemaphore = semaPt;
+  if (priority < KERNELPRIORITY) {
+    priority = KERNELPRIORITY;
+  }
   SYSCTL_RCGCGPIO_R |= SYSCTL_RCGC2_GPIOD; // activate clock for Port D
   while((SYSCTL_PRGPIO_R & SYSCTL_PRGPIO_R3) == 0) {} // allow time for clock to stabilize
   GPIO_PORTD_AMSEL_R &= ~(1 << 6); // disable analog on PD6
@@ -471,9 +2832,11 @@ void OS_EdgeTrigger_Restart(void){
 }
 
 void GPIOPortD_Handler(void){
+  isrEnter();
 	GPIO_PORTD_ICR_R |= (1 << 6); // acknowledge by clearing flag
-  OS_Signal(edgeSemaphore); // signal semaphore (no need to run scheduler)
+  OS_Signal(edgeSemaphore); // signal semaphore, preempts if the waiting thread has higher priority
   GPIO_PORTD_IM_R &= ~(1 << 6); // disarm interrupt to prevent bouncing to create multiple signals
+  isrExit();
 }
 
 
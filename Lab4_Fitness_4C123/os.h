@@ -28,6 +28,146 @@
 #ifndef __OS_H
 #define __OS_H  1
 
+// Counting semaphore that keeps its own queue of blocked threads,
+// so OS_Signal wakes the next thread without searching for it
+#define SEMA4_FIFO     0  // wake blocked threads in the order they blocked
+#define SEMA4_PRIORITY 1  // wake the highest priority blocked thread, FIFO among equals
+struct tcb;
+typedef struct{
+  int32_t value;          // free count, or minus the number of blocked threads
+  uint32_t policy;        // SEMA4_FIFO or SEMA4_PRIORITY
+  struct tcb *waitHead;   // next blocked thread to wake, 0 if none
+  struct tcb *waitTail;   // last blocked thread, valid when waitHead is not 0
+} Sema4Type;
+
+// Timeouts are in ms: a thread that waits with one sleeps and is
+// blocked at the same time, and wakes on whichever ends first.
+#define WAIT_FOREVER 0xFFFFFFFF // timeout that never runs out
+
+// Lock for a shared resource, owned by the thread that locked it.
+// While a higher priority thread is blocked on it, the owner runs
+// at that priority, so medium priority threads cannot hold it up.
+typedef struct mutex{
+  Sema4Type queue;        // blocked threads, highest priority first
+  struct tcb *owner;      // thread holding the mutex, 0 if free
+  struct mutex *heldNext; // next mutex held by the same owner
+} MutexType;
+
+// Group of up to 32 event flags.  A thread can block until any or all
+// of a mask of flags are set; interrupts and threads set and clear
+// them.  Options for OS_EventWait, or'ed together:
+#define EVENT_ANY   0     // wake when any flag in the mask is set
+#define EVENT_ALL   1     // wake when every flag in the mask is set
+#define EVENT_CLEAR 2     // clear the flags in the mask on the way out
+typedef struct{
+  uint32_t flags;         // flags set, bit n is flag n
+  Sema4Type queue;        // blocked threads, highest priority first
+} EventGroupType;
+
+// Queue of fixed-size messages, copied in and out of a buffer the
+// caller supplies, size*depth bytes.  Any number of threads may send
+// and receive; ISRs may too with a timeout of 0.
+typedef struct{
+  uint8_t *buffer;        // depth slots of size bytes
+  uint32_t size;          // bytes per message
+  uint32_t depth;         // messages it can hold
+  uint32_t putI;          // messages sent, free running
+  uint32_t getI;          // messages received, free running
+  Sema4Type items;        // messages waiting, receivers block on it
+  Sema4Type spaces;       // free slots, senders block on it
+  uint32_t lost;          // messages not sent because it stayed full
+} QueueType;
+
+// Lock-free ring of words from one producer, usually an ISR, to one
+// consumer thread.  Putting and getting never disable interrupts;
+// the consumer is signalled once per threshold words.
+typedef struct{
+  uint32_t *buffer;       // mask+1 words
+  uint32_t mask;          // size-1, size is a power of 2
+  volatile uint32_t putI; // words put, free running, written by the producer
+  volatile uint32_t getI; // words taken, free running, written by the consumer
+  uint32_t threshold;     // words that wake the consumer
+  Sema4Type ready;        // signalled when putI-getI reaches threshold
+  uint32_t lost;          // words not put because it was full
+} RingType;
+
+// Interrupts at NVIC priority KERNELPRIORITY to 7 may call the OS, and
+// the OS masks them in its critical sections.  Interrupts at a higher
+// priority, 0 to KERNELPRIORITY-1, are never masked by the OS, so
+// their latency stays fixed, but they must never call the OS.
+// KERNELPRIORITY 0 masks every interrupt, with PRIMASK.
+#ifndef KERNELPRIORITY
+#define KERNELPRIORITY 1
+#endif
+
+// With LINEARSCAN 1 the original Lab 4 scheduler and OS_Signal,
+// which walk the thread ring, are compiled in as
+// SchedulerLinearScan and OS_SignalLinearScan, so Lab4.c Steps 7
+// and 8 can time them against the kernel's own.  They are only a
+// reference, never call them from an application.
+#ifndef LINEARSCAN
+#define LINEARSCAN 0
+#endif
+
+// With TRACE 1 the OS records each context switch, semaphore wait
+// and signal, thread wakeup, interrupt and periodic release, time
+// stamped in bus cycles, for OS_TraceDrain to send over UART0.
+// With TRACE 0 none of it is compiled in.
+#ifndef TRACE
+#define TRACE 0
+#endif
+#define TRACE_START    0  // tracing started, arg is the bus clock in MHz
+#define TRACE_SWITCH   1  // thread now running, arg is the one switched out
+#define TRACE_WAIT     2  // thread calls OS_Wait, arg is the semaphore address
+#define TRACE_SIGNAL   3  // thread or ISR calls OS_Signal, arg as TRACE_WAIT
+#define TRACE_WAKE     4  // thread made ready by a signal, sleep or timeout
+#define TRACE_ISRENTER 5  // OS interrupt handler starts, arg is its vector
+#define TRACE_ISREXIT  6  // OS interrupt handler ends, arg is its vector
+#define TRACE_RELEASE  7  // periodic job released, arg is the trigger
+#define TRACE_LOST     8  // arg events were lost with the buffer full
+#define TRACE_ALL 0x1FF   // mask for every event type
+
+// Stack sizes are in 32-bit words and are rounded up to an even
+// number, so every stack stays 8-byte aligned.  Interrupts and the
+// context switch, FP registers included, push onto the running
+// thread's stack, so no stack is made smaller than STACKMIN.
+#define STACKMIN 64
+
+// Software timer.  Its callback runs in the OS timer interrupt with
+// the kernel masked, like an event thread: it must be short and never
+// block or sleep, but it can call OS_Signal and start or stop timers,
+// which restore the mask they found rather than unmasking.  A timer set up by OS_InitWorkTimer posts a work item
+// instead, which may take longer.
+typedef struct timer{
+  void (*callback)(void); // function to call when it expires
+  void (*work)(uint32_t); // work item to post when it expires, 0 to call callback
+  uint32_t data;          // argument for work
+  uint32_t period;        // ms between callbacks, 0 for a one-shot timer
+  uint32_t expires;       // timer wheel time it is due
+  struct timer **slot;    // wheel slot it is in, 0 if stopped
+  struct timer *next;     // next timer in the same slot
+  struct timer *prev;     // previous timer in the same slot, 0 if first
+} TimerType;
+
+// CPU usage from OS_GetStats, in 0.1% units
+#define STATSTHREADS 8    // main threads reported, in the order added
+typedef struct{
+  uint32_t thread[STATSTHREADS]; // each main thread, 0 if not added
+  uint32_t isr;           // OS interrupt handlers: SysTick, sleep timer, triggers
+  uint32_t idle;          // idle thread, the processor sleeping in WFI
+  uint32_t work;          // kernel work thread, running posted work items
+  uint32_t maskedWorst;   // longest the OS kept interrupts masked, in us
+} OSStatsType;
+
+// Periodic jobs of one thread from OS_GetDeadlines.  OS_PeriodTrigger0/1
+// release a job at fixed times; it finishes when the thread waits on
+// the trigger semaphore again, and its deadline is the next release.
+// A thread given a deadline by OS_SetDeadline is checked against that.
+typedef struct{
+  uint32_t jobs;          // jobs finished
+  uint32_t misses;        // jobs still running at their deadline
+  int32_t worstLateness;  // us from deadline to finish, worst job; negative if all were early
+} DeadlineStatsType;
 
 // ******** OS_Init ************
 // Initialize operating system, disable interrupts
@@ -41,18 +181,133 @@ void OS_Init(void);
 // Add eight main threads to the scheduler
 // Inputs: function pointers to eight void/void main threads
 //         priorites for each main thread (0 highest)
+//         stack sizes for each main thread in 32-bit words
 // Outputs: 1 if successful, 0 if this thread can not be added
 // This function will only be called once, after OS_Init and before OS_Launch
-int OS_AddThreads(void(*thread0)(void), uint32_t p0,
-                  void(*thread1)(void), uint32_t p1,
-                  void(*thread2)(void), uint32_t p2,
-                  void(*thread3)(void), uint32_t p3,
-                  void(*thread4)(void), uint32_t p4,
-                  void(*thread5)(void), uint32_t p5,
-                  void(*thread6)(void), uint32_t p6,
-                  void(*thread7)(void), uint32_t p7);
+int OS_AddThreads(void(*thread0)(void), uint32_t p0, uint32_t s0,
+                  void(*thread1)(void), uint32_t p1, uint32_t s1,
+                  void(*thread2)(void), uint32_t p2, uint32_t s2,
+                  void(*thread3)(void), uint32_t p3, uint32_t s3,
+                  void(*thread4)(void), uint32_t p4, uint32_t s4,
+                  void(*thread5)(void), uint32_t p5, uint32_t s5,
+                  void(*thread6)(void), uint32_t p6, uint32_t s6,
+                  void(*thread7)(void), uint32_t p7, uint32_t s7);
+
+//******** OS_AddThread ***************
+// Add one main thread to the scheduler
+// Inputs: pointer to a void/void main thread
+//         priority (0 highest, 30 lowest, 31 is the idle thread)
+//         stack size in 32-bit words, at least STACKMIN
+// Outputs: 1 if successful, 0 if this thread can not be added
+// Called after OS_Init and before OS_Launch
+int OS_AddThread(void(*thread)(void), uint32_t priority, uint32_t stackSize);
+
+//******** OS_SetDeadline ***************
+// Gives a main thread periodic jobs with a relative deadline.  A job
+// ends when the thread sleeps, waits on a trigger semaphore or calls
+// OS_JobDone, and the next one starts when it wakes up.  When os.c
+// is built with EDF=1 these threads run earliest deadline first,
+// ahead of the others.
+// Admitted only if the sum of wcet/min(deadline,period) over all the
+// threads with a deadline stays at or under 1.
+// Inputs: thread number, 0 for the first thread added
+//         period in ms, the shortest time between jobs
+//         deadline in ms from the start of each job, 0 for the period
+//         wcet, worst case execution time of one job in us
+// Outputs: 1 if admitted, 0 if not
+// Called after OS_AddThread and before OS_Launch
+int OS_SetDeadline(uint32_t id, uint32_t period, uint32_t deadline, uint32_t wcet);
+
+// ******** OS_StackArenaFree ************
+// Number of 32-bit words of stack space not yet given to a thread
+// Inputs:  none
+// Outputs: free words in the stack arena
+uint32_t OS_StackArenaFree(void);
+
+// ******** OS_StackUsage ************
+// Most stack a thread has ever used.  Stacks start out filled with
+// a pattern, so this is the high-water mark since OS_AddThread.
+// Inputs:  thread number, 0 for the first thread added
+// Outputs: 32-bit words used, 0 if there is no such thread
+uint32_t OS_StackUsage(uint32_t id);
+
+// ******** OS_StartCritical ************
+// Mask the interrupts that may call the OS, the ones at
+// KERNELPRIORITY and below, and nothing more urgent.
+// Use it instead of StartCritical around data shared with them.
+// Inputs:  none
+// Outputs: mask to pass to OS_EndCritical
+long OS_StartCritical(void);
+
+// ******** OS_EndCritical ************
+// Restore the mask from OS_StartCritical
+// Inputs:  mask OS_StartCritical returned
+// Outputs: none
+void OS_EndCritical(long sr);
+
+// ******** OS_GetStats ************
+// Share of the CPU used by each main thread, the OS interrupt
+// handlers and the idle thread since the previous call or OS_Launch,
+// and the longest the OS kept interrupts masked in that time.
+// Counting then starts again, so call it at a steady rate.
+// Inputs:  pointer to the stats to fill in
+// Outputs: none
+void OS_GetStats(OSStatsType *statsPt);
+
+#if TRACE
+// ******** OS_TraceStart ************
+// Empty the trace buffer and start recording the given event types
+// Inputs:  1<<TRACE_SWITCH | ... for the types to record, TRACE_ALL for all
+// Outputs: none
+void OS_TraceStart(uint32_t mask);
+
+// ******** OS_TraceDrain ************
+// Send the recorded events over UART0, each as 9 bytes:
+// 0xA5, type, thread, arg (2 bytes) and bus cycles (4 bytes),
+// least significant byte first.  UART0_Init must have been called.
+// Inputs:  none
+// Outputs: number of events sent
+uint32_t OS_TraceDrain(void);
+
+// ******** OS_TraceThread ************
+// Main thread that sends the recorded events every 10 ms.
+// UART0 at 115,200 bps carries about 1,280 events a second;
+// with more, events are lost and reported as TRACE_LOST.
+// Inputs:  none
+// Outputs: none
+void OS_TraceThread(void);
+#endif
+
+// ******** OS_GetDeadlines ************
+// Jobs finished, deadlines missed and worst lateness of a thread
+// given a deadline by OS_SetDeadline, or released by
+// OS_PeriodTrigger0_Init or OS_PeriodTrigger1_Init, counted since
+// OS_AddThread
+// Inputs:  thread number, 0 for the first thread added
+//          pointer to the record to fill in
+// Outputs: 1 if successful, 0 if there is no such thread
+int OS_GetDeadlines(uint32_t id, DeadlineStatsType *statsPt);
 
 
+// ******** OS_WorkQueue_Init ************
+// Create the kernel work thread that runs items from OS_WorkPost.
+// It is not a main thread, so it takes no thread number.
+// Inputs:  priority (0 highest, 30 lowest)
+//          stack size in 32-bit words, for the deepest work item
+// Outputs: 1 if successful, 0 if there is no room for its stack
+// Called after OS_Init and before OS_Launch
+int OS_WorkQueue_Init(uint32_t priority, uint32_t stackSize);
+
+// ******** OS_WorkPost ************
+// Queue a function for the work thread to run with interrupts
+// enabled, so an interrupt handler can leave its slow part, even
+// one that blocks or sleeps, to a thread.  Items run in the order
+// they were posted.  Can be called from interrupt handlers.
+// Inputs:  function to run, void/uint32_t
+//          argument to pass it
+// Outputs: 1 if successful, 0 if the queue was full and the item lost
+int OS_WorkPost(void(*work)(uint32_t), uint32_t data);
+
 //******** OS_Launch ***************
 // Start the scheduler, enable interrupts
 // Inputs: number of clock cycles for each time slice
@@ -69,17 +324,48 @@ void OS_Suspend(void);
 
 // ******** OS_Sleep ************
 // place this thread into a dormant state
-// input:  number of msec to sleep
+// input:  number of msec to sleep, 1 ms resolution
 // output: none
 // OS_Sleep(0) implements cooperative multitasking
 void OS_Sleep(uint32_t sleepTime);
 
+// ******** OS_SleepUntil ************
+// place this thread into a dormant state until an absolute time,
+// so a loop that adds its period to wakeTime does not drift
+// input:  OS_MsTime() value to wake up at
+// output: none
+// a wakeTime that has already passed behaves like OS_Sleep(0)
+void OS_SleepUntil(uint32_t wakeTime);
+
+// ******** OS_JobDone ************
+// ends the current job of a thread given a deadline by OS_SetDeadline,
+// for one that waits for its next job on a semaphore or event that is
+// not a trigger; the next job starts when the thread next wakes up,
+// or at once if its next wait does not block
+// input:  none
+// output: none
+void OS_JobDone(void);
+
+// ******** OS_MsTime ************
+// reads the time since OS_Launch
+// Inputs:  none
+// Outputs: time in ms, rolls over after 49 days
+uint32_t OS_MsTime(void);
+
 // ******** OS_InitSemaphore ************
-// Initialize counting semaphore
+// Initialize counting semaphore, blocked threads wake in FIFO order
 // Inputs:  pointer to a semaphore
 //          initial value of semaphore
 // Outputs: none
-void OS_InitSemaphore(int32_t *semaPt, int32_t value);
+void OS_InitSemaphore(Sema4Type *semaPt, int32_t value);
+
+// ******** OS_InitSemaphorePolicy ************
+// Initialize counting semaphore with a choice of wake order
+// Inputs:  pointer to a semaphore
+//          initial value of semaphore
+//          SEMA4_FIFO or SEMA4_PRIORITY
+// Outputs: none
+void OS_InitSemaphorePolicy(Sema4Type *semaPt, int32_t value, uint32_t policy);
 
 // ******** OS_Wait ************
 // Decrement semaphore and block if less than zero
@@ -87,7 +373,7 @@ void OS_InitSemaphore(int32_t *semaPt, int32_t value);
 // Lab3 block if less than zero
 // Inputs:  pointer to a counting semaphore
 // Outputs: none
-void OS_Wait(int32_t *semaPt);
+void OS_Wait(Sema4Type *semaPt);
 
 // ******** OS_Signal ************
 // Increment semaphore
@@ -95,7 +381,181 @@ void OS_Wait(int32_t *semaPt);
 // Lab3 wakeup blocked thread if appropriate
 // Inputs:  pointer to a counting semaphore
 // Outputs: none
-void OS_Signal(int32_t *semaPt);
+void OS_Signal(Sema4Type *semaPt);
+
+// ******** OS_WaitTimeout ************
+// Decrement semaphore, blocking for at most timeout ms
+// Inputs:  pointer to a counting semaphore
+//          ms to wait, 0 to not wait, WAIT_FOREVER for no limit
+// Outputs: 1 if the semaphore was taken, 0 if the time ran out
+int OS_WaitTimeout(Sema4Type *semaPt, uint32_t timeout);
+
+// ******** OS_InitMutex ************
+// Initialize a mutex as free
+// Inputs:  pointer to a mutex
+// Outputs: none
+void OS_InitMutex(MutexType *mutexPt);
+
+// ******** OS_MutexLock ************
+// Take the mutex, blocking while another thread owns it.
+// The owner inherits the priority of the threads it blocks.
+// Only main threads may lock, never event threads or ISRs.
+// Inputs:  pointer to a mutex
+// Outputs: 1 if successful, 0 if this thread already owns it
+int OS_MutexLock(MutexType *mutexPt);
+
+// ******** OS_MutexUnlock ************
+// Release the mutex, handing it to the highest priority blocked thread,
+// and drop back to the priority the thread had before it inherited
+// Inputs:  pointer to a mutex
+// Outputs: 1 if successful, 0 if this thread does not own it
+int OS_MutexUnlock(MutexType *mutexPt);
+
+// ******** OS_InitEventGroup ************
+// Initialize an event group with every flag clear
+// Inputs:  pointer to an event group
+// Outputs: none
+void OS_InitEventGroup(EventGroupType *groupPt);
+
+// ******** OS_EventWait ************
+// Block until any, or all, of the flags in a mask are set.
+// Only main threads may wait.
+// Inputs:  pointer to an event group
+//          flags to wait for, not 0
+//          EVENT_ANY or EVENT_ALL, or'ed with EVENT_CLEAR to consume them
+// Outputs: the flags in the mask that were set when it woke
+uint32_t OS_EventWait(EventGroupType *groupPt, uint32_t mask, uint32_t options);
+
+// ******** OS_EventSet ************
+// Set flags, waking every thread whose wait they complete, highest
+// priority first.  Can be called from interrupt handlers.
+// Inputs:  pointer to an event group
+//          flags to set
+// Outputs: none
+void OS_EventSet(EventGroupType *groupPt, uint32_t flags);
+
+// ******** OS_EventClear ************
+// Clear flags.  Can be called from interrupt handlers.
+// Inputs:  pointer to an event group
+//          flags to clear
+// Outputs: none
+void OS_EventClear(EventGroupType *groupPt, uint32_t flags);
+
+// ******** OS_EventGet ************
+// Read the flags without waiting
+// Inputs:  pointer to an event group
+// Outputs: the flags that are set
+uint32_t OS_EventGet(EventGroupType *groupPt);
+
+// ******** OS_InitTimer ************
+// Initialize a software timer as stopped
+// Inputs:  pointer to a timer
+//          function to call when it expires
+// Outputs: none
+void OS_InitTimer(TimerType *timerPt, void(*callback)(void));
+
+// ******** OS_InitWorkTimer ************
+// Initialize a software timer as stopped, that posts a work item
+// when it expires, see OS_WorkPost
+// Inputs:  pointer to a timer
+//          function for the work thread to run
+//          argument to pass it
+// Outputs: none
+void OS_InitWorkTimer(TimerType *timerPt, void(*work)(uint32_t), uint32_t data);
+
+// ******** OS_TimerStart ************
+// Start a software timer, or restart it if it is running.
+// Delay and period are in ms, up to 2^25-1 (9.3 hours), and
+// time is kept by a 1 ms tick, so callbacks are due on the tick.
+// Inputs:  pointer to a timer
+//          ms until the first callback
+//          ms between callbacks after that, 0 for a one-shot timer
+// Outputs: 1 if successful, 0 if the delay or period is too long
+int OS_TimerStart(TimerType *timerPt, uint32_t delay, uint32_t period);
+
+// ******** OS_TimerStop ************
+// Stop a software timer, its callback will not run again
+// until OS_TimerStart
+// Inputs:  pointer to a timer
+// Outputs: none
+void OS_TimerStop(TimerType *timerPt);
+
+// ******** OS_QueueInit ************
+// Initialize an empty message queue
+// Inputs:  pointer to a queue
+//          buffer of at least size*depth bytes
+//          bytes per message
+//          number of messages it can hold
+// Outputs: none
+void OS_QueueInit(QueueType *queuePt, void *buffer, uint32_t size, uint32_t depth);
+
+// ******** OS_QueueSend ************
+// Copy one message into a queue, waiting for space if it is full
+// Inputs:  pointer to a queue
+//          message of the queue's size
+//          ms to wait for space, 0 to not wait, WAIT_FOREVER for no limit
+// Outputs: 1 if sent, 0 if the queue stayed full
+int OS_QueueSend(QueueType *queuePt, const void *msg, uint32_t timeout);
+
+// ******** OS_QueueRecv ************
+// Copy one message out of a queue, waiting for one if it is empty
+// Inputs:  pointer to a queue
+//          room for a message of the queue's size
+//          ms to wait for a message, 0 to not wait, WAIT_FOREVER for no limit
+// Outputs: 1 if received, 0 if the queue stayed empty
+int OS_QueueRecv(QueueType *queuePt, void *msg, uint32_t timeout);
+
+// ******** OS_QueueSendBurst ************
+// Copy up to count messages into a queue.  Waits for space only
+// for the first, then sends as many more as fit right away.
+// Inputs:  pointer to a queue
+//          array of count messages
+//          number of messages to send
+//          ms to wait for space, 0 to not wait, WAIT_FOREVER for no limit
+// Outputs: number of messages sent
+uint32_t OS_QueueSendBurst(QueueType *queuePt, const void *msgs, uint32_t count, uint32_t timeout);
+
+// ******** OS_QueueRecvBurst ************
+// Copy up to count messages out of a queue.  Waits only for
+// the first, then takes whatever else is already waiting.
+// Inputs:  pointer to a queue
+//          array with room for count messages
+//          most messages to receive
+//          ms to wait for a message, 0 to not wait, WAIT_FOREVER for no limit
+// Outputs: number of messages received
+uint32_t OS_QueueRecvBurst(QueueType *queuePt, void *msgs, uint32_t count, uint32_t timeout);
+
+// ******** OS_RingInit ************
+// Initialize an empty ring
+// Inputs:  pointer to a ring
+//          buffer of size words
+//          size, a power of 2
+//          words it has to hold before the consumer is woken, 1 to size
+// Outputs: 1 if successful, 0 if size or threshold is not allowed
+int OS_RingInit(RingType *ringPt, uint32_t *buffer, uint32_t size, uint32_t threshold);
+
+// ******** OS_RingPut ************
+// Add a word to a ring, called only by its one producer.
+// Safe in an ISR, interrupts stay enabled unless this
+// word brings the ring up to threshold.
+// Inputs:  pointer to a ring
+//          data to be stored
+// Outputs: 1 if successful, 0 if the ring is full
+int OS_RingPut(RingType *ringPt, uint32_t data);
+
+// ******** OS_RingGet ************
+// Take a word from a ring, called only by its one consumer
+// Inputs:  pointer to a ring
+//          place to store the word
+// Outputs: 1 if successful, 0 if the ring is empty
+int OS_RingGet(RingType *ringPt, uint32_t *dataPt);
+
+// ******** OS_RingWait ************
+// Block the consumer until its ring holds threshold words
+// Inputs:  pointer to a ring
+//          ms to wait, 0 to not wait, WAIT_FOREVER for no limit
+// Outputs: number of words in the ring, below threshold if the time ran out
+uint32_t OS_RingWait(RingType *ringPt, uint32_t timeout);
 
 // ******** OS_FIFO_Init ************
 // Initialize FIFO.  The "put" and "get" indices initially
@@ -126,28 +586,63 @@ int OS_FIFO_Put(uint32_t data);
 // Outputs: data retrieved
 uint32_t OS_FIFO_Get(void);
 
+// ******** OS_FIFO_GetTimeout ************
+// Get an entry from the FIFO, blocking for at most timeout ms
+// Inputs:  place to store the entry
+//          ms to wait, 0 to not wait, WAIT_FOREVER for no limit
+// Outputs: 1 if successful, 0 if the FIFO stayed empty
+int OS_FIFO_GetTimeout(uint32_t *dataPt, uint32_t timeout);
+
+// ******** OS_MailBox_Init ************
+// Initialize communication channel
+// Producer is an event thread, consumer is a main thread
+// Inputs:  none
+// Outputs: none
+void OS_MailBox_Init(void);
+
+// ******** OS_MailBox_Send ************
+// Enter data into the MailBox, do not spin/block if full
+// Inputs:  data to be sent
+// Outputs: none
+// Errors: data lost if MailBox already has data
+void OS_MailBox_Send(uint32_t data);
+
+// ******** OS_MailBox_Recv ************
+// retreive mail from the MailBox
+// block on semaphore if mailbox empty
+// Inputs:  none
+// Outputs: data retreived
+uint32_t OS_MailBox_Recv(void);
+
+// ******** OS_MailBox_RecvTimeout ************
+// retreive mail from the MailBox, blocking for at most timeout ms
+// Inputs:  place to store the mail
+//          ms to wait, 0 to not wait, WAIT_FOREVER for no limit
+// Outputs: 1 if successful, 0 if no mail came
+int OS_MailBox_RecvTimeout(uint32_t *dataPt, uint32_t timeout);
+
 // ******** OS_PeriodTrigger0_Init ************
 // Initialize periodic timer interrupt to signal 
 // Inputs:  semaphore to signal
 //          period in ms
-// priority level at 0 (highest)
+// priority level KERNELPRIORITY, the highest that may call the OS
 // Outputs: none
-void OS_PeriodTrigger0_Init(int32_t *semaPt, uint32_t period);
+void OS_PeriodTrigger0_Init(Sema4Type *semaPt, uint32_t period);
 
 // ******** OS_PeriodTrigger1_Init ************
 // Initialize periodic timer interrupt to signal 
 // Inputs:  semaphore to signal
 //          period in ms
-// priority level at 0 (highest)
+// priority level KERNELPRIORITY, the highest that may call the OS
 // Outputs: none
-void OS_PeriodTrigger1_Init(int32_t *semaPt, uint32_t period);
+void OS_PeriodTrigger1_Init(Sema4Type *semaPt, uint32_t period);
 
 // ******** OS_EdgeTrigger_Init ************
 // Initialize button1, PD6, to signal on a falling edge interrupt
 // Inputs:  semaphore to signal
-//          priority
+//          priority, raised to KERNELPRIORITY since it calls the OS
 // Outputs: none
-void OS_EdgeTrigger_Init(int32_t *semaPt, uint8_t priority);
+void OS_EdgeTrigger_Init(Sema4Type *semaPt, uint8_t priority);
 
 // ******** OS_EdgeTrigger_Restart ************
 // restart button1 to signal on a falling edge interrupt
@@ -13,33 +13,57 @@
         PRESERVE8
 
         EXTERN  RunPt            ; currently running thread
+        EXTERN  KernelMask       ; BASEPRI for kernel critical sections, 0 for PRIMASK
         EXPORT  StartOS
-        EXPORT  SysTick_Handler
+        EXPORT  PendSV_Handler
         IMPORT  Scheduler
 
+; PendSV runs at the lowest priority, after every other ISR has finished,
+; whenever the kernel has asked for a switch (SysTick or a thread woken
+; at a higher priority than RunPt)
+; Bit 4 of EXC_RETURN in LR is 0 when the interrupted thread has used
+; the FPU and the hardware reserved an extended frame (S0-S15, FPSCR).
+; Only then are S16-S31 saved, and EXC_RETURN is kept on each thread's
+; stack so the restore knows which kind of frame to return through.
+; Threads that never touch the FPU pay nothing extra.
+; The switch masks the same interrupts as the rest of the kernel, so
+; interrupts above KERNELPRIORITY can still run on the old or new stack.
+PendSV_Handler                 ; 1) Saves R0-R3,R12,LR,PC,PSR (and S0-S15,FPSCR lazily)
+    LDR     R2, =KernelMask    ; 2) Prevent interrupts that use the OS during switch
+    LDR     R2, [R2]
+    MSR     BASEPRI, R2
+    CBNZ    R2, PendSV_Masked
+    CPSID   I                  ; 2.5) KernelMask 0, mask them all
+PendSV_Masked
 
-SysTick_Handler                ; 1) Saves R0-R3,R12,LR,PC,PSR
-    CPSID   I                  ; 2) Prevent interrupt during switch
-
-    PUSH    {R4-R11}           ; 3) Push R4-R11
+    TST     LR, #0x10          ; 3) FP context?
+    IT      EQ
+    VPUSHEQ {S16-S31}          ; 3.5) Push S16-S31, stacks S0-S15 first
+    PUSH    {R4-R11, LR}       ; 3.75) Push R4-R11 and EXC_RETURN
     LDR     R0, =RunPt         ; 4) Load pointer to RunPt
     LDR     R1, [R0]           ; 4.5) Load current RunPt into R1
     STR     SP, [R1]           ; 5) Store Real SP into TCB SP
-    PUSH    {R0, LR}           ; 6) Call Scheduler
-    BL      Scheduler
-    POP     {R0, LR}
-    LDR     R1, [R0]           ; 6.5) Scheduler returns new RunPt, store into R1 
-    LDR     SP, [R1]           ; 7) SP = RunPt->SP
-    POP     {R4-R11}           ; 8) Pop R4-R11
+    SUB     SP, SP, #4         ; 6) 9 words pushed, pad so SP is 8-byte aligned for C
+    BL      Scheduler          ; 6.25) Call Scheduler, LR comes back off the new stack
+    LDR     R0, =RunPt         ; 6.5) Scheduler has set RunPt, load the new one into R1
+    LDR     R1, [R0]
+    LDR     SP, [R1]           ; 7) SP = RunPt->SP, the pad stays behind on the old stack
+    POP     {R4-R11, LR}       ; 8) Pop R4-R11 and EXC_RETURN
+    TST     LR, #0x10          ; 8.5) FP context?
+    IT      EQ
+    VPOPEQ  {S16-S31}          ; 8.75) Pop S16-S31
 
+    MOV     R0, #0
+    MSR     BASEPRI, R0
     CPSIE   I                  ; 9) tasks run with interrupts enabled
-    BX      LR                 ; 10) restore R0-R3,R12,LR,PC,PSR
+    BX      LR                 ; 10) restore R0-R3,R12,LR,PC,PSR (and S0-S15,FPSCR)
     
 StartOS    
     LDR     R0, =RunPt       ; Load address of RunPt into R0   
     LDR     R1, [R0]         ; R1 = value of RunPt (pointer to current thread)   
     LDR     SP, [R1]         ; Load new thread SP (SP = RunPt->sp)   
     POP     {R4-R11}         ; Restore registers R4-R11   
+    ADD     SP, SP, #4       ; Discard EXC_RETURN, StartOS is not an exception return
     POP     {R0-R3}          ; Restore registers R0-R3   
     POP     {R12}            ; Restore register R12
     ADD     SP, SP, #4       ; Discard LR from initial stack   
@@ -460,13 +460,17 @@ void Task6(void){ uint32_t lightData;
 /*          End of Task6 Section              */
 /* ****************************************** */
 
-//---------------- Task7 dummy function ----------------
+//---------------- Task7 Bluetooth function ----------------
 // *********Task7*********
 // Main thread scheduled by OS round robin preemptive scheduler
-// Task7 checks for Bluetooth incoming frames but never blocks or sleeps
+// Task7 checks for Bluetooth incoming frames every 10 ms, the
+// resolution of OS_Sleep; the OS idle thread has the CPU when
+// no task is ready.  About once a second it reads the idle share
+// into IdleTenths, 0.1% units, for the debugger watch window.
 // Inputs:  none
 // Outputs: none
 uint32_t Count7;
+uint32_t IdleTenths;
 void Task7(void){
   Count7 = 0;
   while(1){
@@ -476,7 +480,10 @@ void Task7(void){
       AP_SendNotification(0);
       Send0Flag=0;
     }
-    WaitForInterrupt();
+    if(Count7%100 == 0){
+      IdleTenths = OS_IdlePercent();
+    }
+    OS_Sleep(10);
   }
 }
 /* ****************************************** */
@@ -552,7 +559,17 @@ void Bluetooth_Init(void){volatile int r;
 // Task4  temperature    periodically every 1 sec
 // Task5  numbers on LCD after Task0 runs SOUNDRMSLENGTH times
 // Task6  light          periodically every 800 ms
-// Task7  dummy          no timing requirement
+// Task7  Bluetooth      every 10 ms
+// Stacks, in 32-bit words, come from one arena in os.c.  The LCD
+// tasks get 128, Task7 96 for the Bluetooth callbacks, the I2C
+// sensor tasks 80 and Task3 no more than STACKMIN (48).
+//   before: 6 stacks of 100 words          = 600 words, 2400 bytes
+//   after:  2*128 + 96 + 2*80 + 48          = 560 words, 2240 bytes
+// so the task stacks are 160 bytes smaller while the LCD tasks get
+// more room.  The OS idle thread takes another STACKMIN, making the
+// arena 608 words, and each TCB is 8 bytes bigger for its stack, so
+// stacks and TCBs together take 2604 bytes, 108 more than the 2496
+// before; the idle thread costs more than the sizing saves.
 // Remember that you must have exactly one main() function, so
 // to work on this step, you must rename all other main()
 // functions in this file.
@@ -580,7 +597,7 @@ int main(void){
   // Task 1 should run every 100ms
   OS_AddPeriodicEventThread(&Task1, 100);
   // Task2, Task3, Task4, Task5, Task6, Task7 are main threads
-  OS_AddThreads(&Task2, &Task3, &Task4, &Task5, &Task6, &Task7);
+  OS_AddThreads(&Task2,128, &Task3,STACKMIN, &Task4,80, &Task5,128, &Task6,80, &Task7,96);
   // when grading change 1000 to 4-digit number from edX
   BSP_LCD_FillScreen(BSP_LCD_Color565(0, 0, 0));
   UART0_Init();
@@ -14,19 +14,28 @@ void StartOS(void);
 
 #define NUMTHREADS  6        // maximum number of threads
 #define NUMPERIODIC 2        // maximum number of periodic threads
-#define STACKSIZE   100      // number of 32-bit words in stack per thread
+#define IDLETHREAD  NUMTHREADS // index of the kernel idle thread in tcbs
+#ifndef STACKARENA
+#define STACKARENA  (560+STACKMIN) // 32-bit words shared by all stacks, sized for the Lab 6 task set and the idle thread
+#endif
 
 struct tcb{
   int32_t *sp;       // pointer to stack (valid for threads not running
   struct tcb *next;  // linked-list pointer
   int32_t * blocked; // nonzero if blocked on this semaphore
   uint32_t sleepTime; // nonzero if this thread is sleeping
+  int32_t *stack;    // lowest word of its stack in StackArena
+  uint32_t stackSize; // number of 32-bit words in its stack
 };
 
 typedef struct tcb tcbType;
-tcbType tcbs[NUMTHREADS];
+tcbType tcbs[NUMTHREADS+1];   // one extra for the idle thread
 tcbType *RunPt;
-int32_t Stacks[NUMTHREADS][STACKSIZE];
+uint32_t SwitchCycles;        // DWT_CYCCNT when RunPt last started running
+uint32_t IdleCycles;          // cycles in the idle thread since the last OS_IdlePercent
+uint32_t IdleStart;           // DWT_CYCCNT at the last OS_IdlePercent
+int64_t StackArena[STACKARENA/2]; // double words, so every stack is 8-byte aligned
+uint32_t StackUsed;                // words of StackArena given to threads
 
 typedef struct {
   void (*thread)(void);
@@ -39,22 +48,48 @@ eventThread eventThreads[NUMPERIODIC];
 
 void SetInitialStack(int i);
 
+// ******** allocStack ************
+// Takes a stack from StackArena.  Threads are never killed,
+// so stacks are handed out in order and never given back.
+// Input: number of 32-bit words, even so the next stack stays aligned
+// Output: lowest word of the stack, 0 if StackArena is used up
+static int32_t *allocStack(uint32_t stackSize) {
+  int32_t *stack;
+
+  if (stackSize > STACKARENA - StackUsed) {
+    return 0;
+  }
+  stack = (int32_t *)StackArena + StackUsed;
+  StackUsed += stackSize;
+  return stack;
+}
+
 // ******** initializeThread ************
 // Initializes a thread's stack and tcb data
 // Input: the number of the thread to initialize
-// Output: None
-static void initializeThread(int threadNum) {
+//        pointer to the void/void thread function
+//        stack size in 32-bit words
+// Output: 1 if successful, 0 if there is no room for its stack
+static int initializeThread(int threadNum, void(*thread)(void), uint32_t stackSize) {
+  stackSize = (stackSize < STACKMIN) ? STACKMIN : (stackSize + 1) & ~1;
+  tcbs[threadNum].stack = allocStack(stackSize);
+  if (tcbs[threadNum].stack == 0) {
+    return 0;
+  }
+  tcbs[threadNum].stackSize = stackSize;
   SetInitialStack(threadNum);
+  tcbs[threadNum].stack[stackSize-2] = (int32_t)(thread); // PC
   
   tcbs[threadNum].blocked = 0;
   tcbs[threadNum].sleepTime = 0;
 
   if (threadNum == NUMTHREADS-1) {
     tcbs[threadNum].next = &tcbs[0];
-    return;
+    return 1;
   }
 
   tcbs[threadNum].next = &tcbs[threadNum+1];
+  return 1;
 }
 
 // ******** wakeupBlockedThread ************
@@ -80,6 +115,32 @@ static int32_t isThreadReady(tcbType * threadPtr) {
   return (int32_t)(threadPtr->blocked == 0 && threadPtr->sleepTime == 0);
 }
 
+// ******** chargeIdle ************
+// Adds the cycles since SwitchCycles to IdleCycles if the idle
+// thread was running, then starts counting again
+// Called with interrupts disabled
+// Input: None
+// Output: None
+static void chargeIdle(void) {
+  uint32_t const now = DWT_CYCCNT;
+
+  if (RunPt == &tcbs[IDLETHREAD]) {
+    IdleCycles += now - SwitchCycles;
+  }
+  SwitchCycles = now;
+}
+
+// ******** IdleThread ************
+// Kernel thread that runs when no main thread is ready,
+// sleeping the processor until the next interrupt
+// Inputs:  none
+// Outputs: none
+static void IdleThread(void) {
+  while (1) {
+    WaitForInterrupt();
+  }
+}
+
 static void decrementSleepTimer(int32_t const i, int32_t const timeElapsed) {
   if (tcbs[i].sleepTime >= timeElapsed) {
     tcbs[i].sleepTime -= timeElapsed;
@@ -93,10 +154,12 @@ static void decrementSleepTimer(int32_t const i, int32_t const timeElapsed) {
 #define MS_PER_SECOND 1000
 static void updateThreadSleepTimers(void) {
   DisableInterrupts();
+  chargeIdle();           // the handler's own time is not idle
   int32_t const timeElapsed = MS_PER_SECOND / UPDATE_THREAD_SLEEP_TIMERS_EXECUTIONS_PER_SEC;
   for (int i = 0; i < NUMTHREADS; i++) {
     decrementSleepTimer(i, timeElapsed);
   }
+  SwitchCycles = DWT_CYCCNT;
   EnableInterrupts();
 }
 
@@ -113,6 +176,7 @@ static void decrementEventTimer(int32_t i, uint32_t timeElapsed) {
 static void runPeriodicThreads(void) {
   int32_t const timeElapsed = MS_PER_SECOND / UPDATE_PERIODIC_EVENT_THREAD_TIMER_FREQ;
   DisableInterrupts();
+  chargeIdle();           // event threads are work, not idle
   for (int i = 0; i < NUMPERIODIC; i++) {
     decrementEventTimer(i, timeElapsed);
     if (eventThreads[i].timeUntilExecute == 0) {
@@ -120,6 +184,7 @@ static void runPeriodicThreads(void) {
       eventThreads[i].timeUntilExecute = eventThreads[i].period;
     }
   }
+  SwitchCycles = DWT_CYCCNT;
   EnableInterrupts();
 }
 
@@ -133,59 +198,76 @@ static void runPeriodicThreads(void) {
 void OS_Init(void){
   DisableInterrupts();
   BSP_Clock_InitFastest();// set processor clock to fastest speed
+  DEMCR |= 0x01000000;    // TRCENA, enable the DWT unit
+  DWT_CTRL |= 0x00000001; // CYCCNTENA, start the cycle counter for OS_IdlePercent
   // perform any initializations needed
   BSP_PeriodicTask_Init(&updateThreadSleepTimers, UPDATE_THREAD_SLEEP_TIMERS_EXECUTIONS_PER_SEC, 2);
   BSP_PeriodicTask_InitB(&runPeriodicThreads, UPDATE_PERIODIC_EVENT_THREAD_TIMER_FREQ, 2);
 }
 
 void SetInitialStack(int i){
-  tcbs[i].sp = &Stacks[i][STACKSIZE-16]; // thread stack pointer
-  Stacks[i][STACKSIZE-1] = 0x01000000; // Thumb bit
-  Stacks[i][STACKSIZE-3] = 0x14141414; // R14
-  Stacks[i][STACKSIZE-4] = 0x12121212; // R12
-  Stacks[i][STACKSIZE-5] = 0x03030303; // R3
-  Stacks[i][STACKSIZE-6] = 0x02020202; // R2
-  Stacks[i][STACKSIZE-7] = 0x01010101; // R1
-  Stacks[i][STACKSIZE-8] = 0x00000000; // R0
-  Stacks[i][STACKSIZE-9] = 0x11111111; // R11
-  Stacks[i][STACKSIZE-10] = 0x10101010; // R10
-  Stacks[i][STACKSIZE-11] = 0x09090909; // R9
-  Stacks[i][STACKSIZE-12] = 0x08080808; // R8
-  Stacks[i][STACKSIZE-13] = 0x07070707; // R7
-  Stacks[i][STACKSIZE-14] = 0x06060606; // R6
-  Stacks[i][STACKSIZE-15] = 0x05050505; // R5
-  Stacks[i][STACKSIZE-16] = 0x04040404; // R4
+  int32_t *top = &tcbs[i].stack[tcbs[i].stackSize]; // one past the highest word
+  tcbs[i].sp = &top[-16]; // thread stack pointer
+  top[-1] = 0x01000000; // Thumb bit
+  top[-3] = 0x14141414; // R14
+  top[-4] = 0x12121212; // R12
+  top[-5] = 0x03030303; // R3
+  top[-6] = 0x02020202; // R2
+  top[-7] = 0x01010101; // R1
+  top[-8] = 0x00000000; // R0
+  top[-9] = 0x11111111; // R11
+  top[-10] = 0x10101010; // R10
+  top[-11] = 0x09090909; // R9
+  top[-12] = 0x08080808; // R8
+  top[-13] = 0x07070707; // R7
+  top[-14] = 0x06060606; // R6
+  top[-15] = 0x05050505; // R5
+  top[-16] = 0x04040404; // R4
 }
 
 
 //******** OS_AddThreads ***************
 // Add six main threads to the scheduler
 // Inputs: function pointers to six void/void main threads
+//         stack sizes for each main thread in 32-bit words
 // Outputs: 1 if successful, 0 if this thread can not be added
 // This function will only be called once, after OS_Init and before OS_Launch
-int OS_AddThreads(void(*thread0)(void),
-                  void(*thread1)(void),
-                  void(*thread2)(void),
-                  void(*thread3)(void),
-                  void(*thread4)(void),
-                  void(*thread5)(void)){
+int OS_AddThreads(void(*thread0)(void), uint32_t s0,
+                  void(*thread1)(void), uint32_t s1,
+                  void(*thread2)(void), uint32_t s2,
+                  void(*thread3)(void), uint32_t s3,
+                  void(*thread4)(void), uint32_t s4,
+                  void(*thread5)(void), uint32_t s5){
+  void(*threads[NUMTHREADS])(void) = {thread0, thread1, thread2, thread3, thread4, thread5};
+  uint32_t sizes[NUMTHREADS] = {s0, s1, s2, s3, s4, s5};
+
   // **similar to Lab 2. initialize as not blocked, not sleeping****
+  StackUsed = 0;
   for (int i = 0; i < NUMTHREADS; i++) {
-    initializeThread(i);
+    if (initializeThread(i, threads[i], sizes[i]) == 0) {
+      return 0;           // StackArena is used up
+    }
   }
-
-  Stacks[0][STACKSIZE-2] = (int32_t)(thread0); // PC
-  Stacks[1][STACKSIZE-2] = (int32_t)(thread1); // PC
-  Stacks[2][STACKSIZE-2] = (int32_t)(thread2); // PC
-  Stacks[3][STACKSIZE-2] = (int32_t)(thread3); // PC
-  Stacks[4][STACKSIZE-2] = (int32_t)(thread4); // PC
-  Stacks[5][STACKSIZE-2] = (int32_t)(thread5); // PC
+  if (initializeThread(IDLETHREAD, &IdleThread, STACKMIN) == 0) {
+    return 0;
+  }
+  tcbs[IDLETHREAD].next = &tcbs[0]; // not in the ring, see Scheduler
 
   RunPt = &tcbs[0];
 
   return 1;               // successful
 }
 
+// ******** OS_StackArenaFree ************
+// Number of 32-bit words of stack space not yet given to a thread,
+// what is left over once every thread has been added is RAM
+// that STACKARENA could give up
+// Inputs:  none
+// Outputs: free words in the stack arena
+uint32_t OS_StackArenaFree(void){
+  return STACKARENA - StackUsed;
+}
+
 //******** OS_AddPeriodicEventThread ***************
 // Add one background periodic event thread
 // Typically this function receives the highest priority
@@ -223,16 +305,50 @@ void OS_Launch(uint32_t theTimeSlice){
   SYSPRI3 =(SYSPRI3&0x00FFFFFF)|0xE0000000; // priority 7
   STRELOAD = theTimeSlice - 1; // reload value
   STCTRL = 0x00000007;         // enable, core clock and interrupt arm
+  SwitchCycles = IdleStart = DWT_CYCCNT;
   StartOS();                   // start on the first task
 }
 // runs every ms
+// When every main thread is blocked or sleeping the idle thread
+// runs.  Its next points into the ring, just past the last thread
+// that ran, so round robin picks up where it left off.
 void Scheduler(void){ // every time slice
+  tcbType *threadPt = RunPt;
+
+  chargeIdle();
   // ROUND ROBIN, skip blocked and sleeping threads
-  RunPt = RunPt->next;
+  for (int i = 0; i < NUMTHREADS; i++) {
+    threadPt = threadPt->next;
+    if (isThreadReady(threadPt)) {
+      RunPt = threadPt;
+      return;
+    }
+  }
+  tcbs[IDLETHREAD].next = threadPt->next;
+  RunPt = &tcbs[IDLETHREAD];
+}
 
-  while (!isThreadReady(RunPt)) {
-    RunPt = RunPt->next;
+// ******** OS_IdlePercent ************
+// Share of the CPU the idle thread had since the previous call,
+// or since OS_Launch, then starts counting again.  Time in the OS
+// interrupt handlers and event threads is not idle.  No stretch
+// may run longer than 2^32 cycles (53 s at 80 MHz).
+// Inputs:  none
+// Outputs: idle time in 0.1% units, 1000 means always idle
+uint32_t OS_IdlePercent(void){
+  uint32_t total, idle;
+
+  DisableInterrupts();
+  chargeIdle();
+  total = SwitchCycles - IdleStart;
+  idle = IdleCycles;
+  IdleStart = SwitchCycles;
+  IdleCycles = 0;
+  EnableInterrupts();
+  if (total == 0) {
+    return 0;             // called twice in a row
   }
+  return (uint32_t)(((uint64_t)idle*1000)/total);
 }
 
 //******** OS_Suspend ***************
@@ -28,6 +28,11 @@
 #ifndef __OS_H
 #define __OS_H  1
 
+// Stack sizes are in 32-bit words and are rounded up to an even
+// number, so every stack stays 8-byte aligned.  Interrupts and the
+// context switch push onto the running thread's stack, so no stack
+// is made smaller than STACKMIN.
+#define STACKMIN 48
 
 // ******** OS_Init ************
 // Initialize operating system, disable interrupts
@@ -40,14 +45,21 @@ void OS_Init(void);
 //******** OS_AddThreads ***************
 // Add six main threads to the scheduler
 // Inputs: function pointers to six void/void main threads
+//         stack sizes for each main thread in 32-bit words
 // Outputs: 1 if successful, 0 if this thread can not be added
 // This function will only be called once, after OS_Init and before OS_Launch
-int OS_AddThreads(void(*thread0)(void),
-                  void(*thread1)(void),
-                  void(*thread2)(void),
-                  void(*thread3)(void),
-                  void(*thread4)(void),
-                  void(*thread5)(void));
+int OS_AddThreads(void(*thread0)(void), uint32_t s0,
+                  void(*thread1)(void), uint32_t s1,
+                  void(*thread2)(void), uint32_t s2,
+                  void(*thread3)(void), uint32_t s3,
+                  void(*thread4)(void), uint32_t s4,
+                  void(*thread5)(void), uint32_t s5);
+
+// ******** OS_StackArenaFree ************
+// Number of 32-bit words of stack space not yet given to a thread
+// Inputs:  none
+// Outputs: free words in the stack arena
+uint32_t OS_StackArenaFree(void);
 
 //******** OS_AddPeriodicEventThread ***************
 // Add one background periodic event thread
@@ -69,6 +81,13 @@ int OS_AddPeriodicEventThread(void(*thread)(void), uint32_t period);
 // Errors: theTimeSlice must be less than 16,777,216
 void OS_Launch(uint32_t theTimeSlice);
 
+// ******** OS_IdlePercent ************
+// Share of the CPU the idle thread had since the previous call,
+// or since OS_Launch, then starts counting again
+// Inputs:  none
+// Outputs: idle time in 0.1% units, 1000 means always idle
+uint32_t OS_IdlePercent(void);
+
 //******** OS_Suspend ***************
 // Called by main thread to cooperatively suspend operation
 // Inputs: none
@@ -822,6 +822,68 @@ void IdleTask(void){ // dummy task
     Freetime++; 
   }
 }
+//---------------- Spawn/kill benchmark ----------------
+// Measures how fast the OS creates and destroys threads, the way
+// EnemyCreateTask and EnemyTask do during the game.  SpawnTask
+// adds a short thread at higher priority, which runs when SpawnTask
+// suspends, counts, and kills itself.  SpawnTask first sleeps so the
+// filler threads run once and go to sleep; they keep the thread list
+// full so the cost shows up if it depends on the number of threads.
+// Then SpawnTask kills itself and IdleTask runs.  Times come from
+// the DWT cycle counter.
+// Results are read from the debugger watch window.
+// Remember that you must have exactly one main() function, so
+// to run this benchmark, rename the game's main() and rename
+// main_spawnkill() to main().
+#define SPAWNLOOPS 1000
+#define SPAWNFILLERS 17   // NUMTHREADS is 20, leaves one TCB for ShortTask
+uint32_t SpawnCount;      // number of times ShortTask ran
+uint32_t SpawnFailed;     // number of times OS_AddThread returned 0
+uint32_t AddCycles;       // average cycles per OS_AddThread
+uint32_t SpawnKillCycles; // average cycles to add, run and kill one thread
+void ShortTask(void){
+  SpawnCount++;
+  OS_Kill();
+}
+void FillerTask(void){
+  while(1){
+    OS_Sleep(1000);
+  }
+}
+void SpawnTask(void){uint32_t start,mid,addTotal,pairTotal;
+  addTotal = pairTotal = 0;
+  OS_Sleep(10);            // the fillers run and go to sleep
+  for(int i=0; i<SPAWNLOOPS; i++){
+    start = DWT_CYCCNT;
+    if(OS_AddThread(&ShortTask,0) == 0){
+      SpawnFailed++;
+    }
+    mid = DWT_CYCCNT;
+    OS_Suspend();          // ShortTask runs and kills itself
+    addTotal = addTotal + (mid - start);
+    pairTotal = pairTotal + (DWT_CYCCNT - start);
+  }
+  AddCycles = addTotal/SPAWNLOOPS;
+  SpawnKillCycles = pairTotal/SPAWNLOOPS;
+  OS_Kill();
+}
+int main_spawnkill(void){
+  DisableInterrupts();
+  BSP_Clock_InitFastest();
+  OS_Init();
+  DEMCR |= 0x01000000;    // TRCENA, enable the DWT unit
+  DWT_CYCCNT = 0;
+  DWT_CTRL |= 0x00000001; // CYCCNTENA, start the cycle counter
+  SpawnCount = SpawnFailed = 0;
+  OS_AddThread(&SpawnTask,1);
+  for(int i=0; i<SPAWNFILLERS; i++){
+    OS_AddThread(&FillerTask,2);
+  }
+  OS_AddThread(&IdleTask,7); // lowest priority, runs when the others sleep
+  OS_Launch(BSP_Clock_GetFreq()/THREADFREQ); // doesn't return, interrupts enabled in here
+  return 0;               // this never executes
+}
+
 int main(void){uint16_t x,y; uint8_t button;
   DisableInterrupts();
   BSP_Clock_InitFastest();
@@ -14,37 +14,96 @@
 
 // function definitions in osasm.s
 void StartOS(void);
+void Scheduler(void);
 
 #define NUMTHREADS  20       // maximum number of threads
 #define NUMPERIODIC 2        // maximum number of periodic threads
 #define STACKSIZE   100      // number of 32-bit words in stack per thread
+#define NUMPRIORITIES 32     // priority levels, 0 (highest) to 31 (lowest)
 struct tcb{
   int32_t *sp;       // pointer to stack (valid for threads not running
-  struct tcb *next;  // linked-list pointer
+  struct tcb *next;  // linked-list pointer, next free TCB if Id is 0
+  struct tcb *prev;  // previous thread in the circular list
   uint32_t Id;       // 0 means TCB is free
   int32_t *BlockPt;  // nonzero if blocked on this semaphore
   uint32_t Sleep;    // nonzero if this thread is sleeping
   uint32_t Priority; // 0 is highest
+  struct tcb *readyNext; // next ready thread with the same priority
+  struct tcb *readyPrev; // previous ready thread with the same priority
 };
 typedef struct tcb tcbType;
 tcbType tcbs[NUMTHREADS];
 tcbType *RunPt;
-int32_t Stacks[NUMTHREADS][STACKSIZE];
+int32_t Stacks[NUMTHREADS][STACKSIZE]; // Stacks[n] always belongs to tcbs[n]
+tcbType *FreePt;       // free TCBs and their stacks, linked by next
+tcbType *ReadyHead[NUMPRIORITIES]; // next thread to run at each priority, 0 if none ready
+uint32_t ReadyBitmap;  // bit (31-p) is set if priority p has a ready thread
 void static runperiodicevents(void);
 uint32_t NumThread=0;  // number of threads
 uint32_t static ThreadId=0;   // thread Ids are sequential from 1
 
+// ******** addReadyThread ************
+// Appends a thread to the tail of the ready list for its priority,
+// so it runs after the threads already waiting at that priority
+// Called with interrupts disabled
+// Input: thread that has become ready to run
+// Output: none
+void static addReadyThread(tcbType *pt){
+  uint32_t priority = pt->Priority;
+  tcbType *head = ReadyHead[priority];
+  if(head == 0){
+    pt->readyNext = pt;
+    pt->readyPrev = pt;
+    ReadyHead[priority] = pt;
+    ReadyBitmap |= (0x80000000>>priority);
+    return;
+  }
+  pt->readyNext = head;
+  pt->readyPrev = head->readyPrev;
+  head->readyPrev->readyNext = pt;
+  head->readyPrev = pt;
+}
+
+// ******** removeReadyThread ************
+// Unlinks a thread from the ready list for its priority
+// Called with interrupts disabled
+// Input: thread that is about to block, sleep or die
+// Output: none
+void static removeReadyThread(tcbType *pt){
+  uint32_t priority = pt->Priority;
+  if(pt->readyNext == pt){
+    ReadyHead[priority] = 0;
+    ReadyBitmap &= ~(0x80000000>>priority);
+    return;
+  }
+  pt->readyPrev->readyNext = pt->readyNext;
+  pt->readyNext->readyPrev = pt->readyPrev;
+  if(ReadyHead[priority] == pt){
+    ReadyHead[priority] = pt->readyNext;
+  }
+}
+
 // ******** OS_Init ************
 // Initialize operating system, disable interrupts
 // Initialize OS controlled I/O: periodic interrupt, bus clock as fast as possible
 // Initialize OS global variables
 // Inputs:  none
 // Outputs: none
-void OS_Init(void){
+void OS_Init(void){ int n;
   DisableInterrupts();
   BSP_Clock_InitFastest();// set processor clock to fastest speed
   NumThread=0;  // number of threads
   ThreadId=0;   // thread Ids are sequential from 1
+  FreePt = 0;
+  ReadyBitmap = 0;
+  for(n=0; n<NUMPRIORITIES; n++){
+    ReadyHead[n] = 0;
+  }
+  for(n=NUMTHREADS-1; n>=0; n--){
+    tcbs[n].Id = 0;         // mark as free
+    tcbs[n].next = FreePt;  // tcbs[0] is handed out first
+    FreePt = &tcbs[n];
+  }
 // perform any initializations needed, 
 // set up periodic timer to run runperiodicevents to implement sleeping
   BSP_PeriodicTask_InitB(&runperiodicevents, 1000, 0);
@@ -59,29 +118,26 @@ void OS_Init(void){
 // Outputs: Thread ID if successful, 0 if this thread can not be added
 // stack size must be divisable by 8 (aligned to double word boundary)
 int OS_AddThread(void(*task)(void), uint32_t priority){ int status;
-  int n;         // index to new thread TCB 
   tcbType *NewPt;  // Pointer to nex thread TCB
-  tcbType *LastPt; // Pointer to last thread TCB
   int32_t *sp;      // stack pointer
+  if(priority >= NUMPRIORITIES){
+    return 0;
+  }
   status = StartCritical();
-//  NewPt = malloc(stackSize+10);    // 9 extra bytes needed
-  for(n=0; n< NUMTHREADS; n++){
-    if(tcbs[n].Id == 0) break; // found it 
-    if(n == NUMTHREADS-1){  
-      EndCritical(status);
-      return 0;          // heap is full
-    }
+  NewPt = FreePt;  // take the first free TCB, its stack comes with it
+  if(NewPt == 0){
+    EndCritical(status);
+    return 0;          // heap is full
   }
-  NewPt = &tcbs[n]; 
+  FreePt = NewPt->next;
   if(NumThread==0){
     RunPt = NewPt;  // points to first thread created
+    NewPt->prev = NewPt;
   } else{
-    LastPt = RunPt;
-    while(LastPt->next != RunPt){
-      LastPt = LastPt->next;
-    }
-    LastPt->next = NewPt; // Pointer to Next  
+    NewPt->prev = RunPt->prev; // RunPt->prev is the last thread, no search
+    RunPt->prev->next = NewPt; // Pointer to Next  
   }
+  RunPt->prev = NewPt;  // new thread is now last
   NewPt->Priority =  priority;
   NumThread++;
   ThreadId++;
@@ -89,7 +145,7 @@ int OS_AddThread(void(*task)(void), uint32_t priority){ int status;
   NewPt->BlockPt =  0;    // not blocked
   NewPt->Sleep =  0;      // not sleeping
 
-  sp = &Stacks[n][STACKSIZE-1];      // last entry of stack
+  sp = &Stacks[NewPt-tcbs][STACKSIZE-1];      // last entry of stack
 
 
 // derived from uCOS-II
@@ -114,6 +170,7 @@ int OS_AddThread(void(*task)(void), uint32_t priority){ int status;
   *(--sp)  = (long)0x04040404L;             /* R4                                                 */
   NewPt->sp = sp;        // make stack "look like it was previously suspended"
   NewPt->next = RunPt;   // Pointer to first, circular linked list 
+  addReadyThread(NewPt);
   EndCritical(status);
   return 1;
 }
@@ -125,11 +182,20 @@ uint32_t OS_Id(void){
   return RunPt->Id;
 }
 
-void static runperiodicevents(void){
-// ****IMPLEMENT THIS****
-// **DECREMENT SLEEP COUNTERS
-// In Lab 4, handle periodic events in RealTimeEvents
-  
+void static runperiodicevents(void){ tcbType *pt;
+  if(NumThread == 0){
+    return;
+  }
+  pt = RunPt;
+  do{            // killed threads are never in the list
+    if(pt->Sleep){
+      pt->Sleep--;
+      if(pt->Sleep == 0){
+        addReadyThread(pt);  // done sleeping
+      }
+    }
+    pt = pt->next;
+  }while(pt != RunPt);
 }
 
 //******** OS_Launch ***************
@@ -143,16 +209,18 @@ void OS_Launch(uint32_t theTimeSlice){
   SYSPRI3 =(SYSPRI3&0x0000FFFF)|0xE0E00000; // priority 7, SysTick and PendSV
   STRELOAD = theTimeSlice - 1; // reload value
   STCTRL = 0x00000007;         // enable, core clock and interrupt arm
+  Scheduler();                 // first task is the highest priority ready thread
   StartOS();                   // start on the first task
 }
 // runs every ms
+// The highest priority with a ready thread is the number of leading zeros
+// in ReadyBitmap, and ReadyHead rotates through the threads at that
+// priority, so a switch costs the same no matter how many threads exist.
+// Assumes at least one thread (e.g., IdleTask) never blocks or sleeps.
 void Scheduler(void){      // every time slice
-// ****IMPLEMENT THIS****
-// look at all threads in TCB list choose
-// highest priority thread not blocked and not sleeping 
-// If there are multiple highest priority (not blocked, not sleeping) run these round robin
-
-  
+  uint32_t priority = __builtin_clz(ReadyBitmap); // CLZ instruction
+  RunPt = ReadyHead[priority];
+  ReadyHead[priority] = RunPt->readyNext; // round robin among equals
 }
 
 //******** OS_Suspend ***************
@@ -180,37 +248,38 @@ void OS_Kill(void){  // no local variables allowed
     for(;;){};     // crash
   }
   RunPt->Sleep = 0xFFFFFFFF;  // can't rerun this thread, it will be dead
+  removeReadyThread(RunPt);
   killPt = RunPt;             // kill current thread
 	Scheduler();                // RunPt points to thread to run next
 //********initially RunPt points to thread to kill********
 //               /----\           /----\          /----\
 //               |    |  killPt-> |    |          |    |
 //               |next----------> |next---------> |next--->
-//               |    |           |    |          |    |
+//               |prev<---------- |prev<--------- |prev<---
 //               \----/           \----/          \----/
   killPt->Id = 0;         // mark as free
  
-  previousPt = killPt;    // eventually, it will point to previous thread 
+  previousPt = killPt->prev; // the list is doubly linked, no search
   nextPt = killPt->next;  // nextPt points to the thread after 
-  while((previousPt->next)!=killPt){
-    previousPt = previousPt->next;  
-  }
 //****previousPt -> one before, RunPt to thread to kill *********
 //               /----\           /----\          /----\
 // previousPt -> |    |  killPt-> |    | nextPt-> |    |
 //               |next----------> |next---------> |next--->
-//               |    |           |    |          |    |
+//               |prev<---------- |prev<--------- |prev<---
 //               \----/           \----/          \----/
   previousPt->next = nextPt; // remove from list
+  nextPt->prev = previousPt;
 //****remove thread which we are killing *********
 //               /----\                           /----\
 // previousPt -> |    |                  nextPt-> |    |
 //               |next--------------------------> |next--->
-//               |    |                           |    |
+//               |prev<-------------------------- |prev<---
 //               \----/                           \----/
+  killPt->next = FreePt;  // TCB and stack can be reused once we switch away,
+  FreePt = killPt;        // only threads add threads and none runs before then
   STCURRENT = 0;        // next thread get full slice
-  EnableInterrupts();
-  INTCTRL = 0x10000000; // trigger pendSV to start next thread
+  INTCTRL = 0x10000000; // trigger pendSV to start next thread, before
+  EnableInterrupts();   // a SysTick at the same priority could save our SP
   for(;;){};            // can not return
 }
 // ******** OS_Sleep ************
@@ -218,11 +287,14 @@ void OS_Kill(void){  // no local variables allowed
 // input:  number of msec to sleep
 // output: none
 // OS_Sleep(0) implements cooperative multitasking
-void OS_Sleep(uint32_t sleepTime){
-// ****IMPLEMENT THIS****
-// set sleep parameter in TCB, same as Lab 3
-// suspend, stops running
-  
+void OS_Sleep(uint32_t sleepTime){ long status;
+  status = StartCritical();
+  RunPt->Sleep = sleepTime; // runperiodicevents counts it down
+  if(sleepTime){
+    removeReadyThread(RunPt);
+  }
+  EndCritical(status);
+  OS_Suspend();             // stops running
 }
 
 // ******** OS_InitSemaphore ************
@@ -231,8 +303,7 @@ void OS_Sleep(uint32_t sleepTime){
 //          initial value of semaphore
 // Outputs: none
 void OS_InitSemaphore(int32_t *semaPt, int32_t value){
-// ****IMPLEMENT THIS****
-// Same as Lab 3
+  *semaPt = value;
 }
 
 // ******** OS_Wait ************
@@ -242,9 +313,15 @@ void OS_InitSemaphore(int32_t *semaPt, int32_t value){
 // Inputs:  pointer to a counting semaphore
 // Outputs: none
 void OS_Wait(int32_t *semaPt){
-// ****IMPLEMENT THIS****
-// Same as Lab 3
-
+  DisableInterrupts();
+  (*semaPt) = (*semaPt) - 1;
+  if((*semaPt) < 0){
+    RunPt->BlockPt = semaPt; // reason it is blocked
+    removeReadyThread(RunPt);
+    EnableInterrupts();
+    OS_Suspend();            // run thread switcher
+  }
+  EnableInterrupts();
 }
 
 // ******** OS_Signal ************
@@ -253,10 +330,18 @@ void OS_Wait(int32_t *semaPt){
 // Lab3 wakeup blocked thread if appropriate
 // Inputs:  pointer to a counting semaphore
 // Outputs: none
-void OS_Signal(int32_t *semaPt){
-// ****IMPLEMENT THIS****
-// Same as Lab 3
-
+void OS_Signal(int32_t *semaPt){ tcbType *pt;
+  long status = StartCritical(); // also called from ISRs
+  (*semaPt) = (*semaPt) + 1;
+  if((*semaPt) <= 0){
+    pt = RunPt->next;        // search for a thread blocked on this semaphore
+    while(pt->BlockPt != semaPt){
+      pt = pt->next;
+    }
+    pt->BlockPt = 0;         // wakeup this one
+    addReadyThread(pt);
+  }
+  EndCritical(status);
 }
 
 #define FSIZE 10    // can be any size
@@ -276,9 +361,9 @@ uint32_t LostData;  // number of lost pieces of data
 // Inputs:  none
 // Outputs: none
 void OS_FIFO_Init(void){
-// ****IMPLEMENT THIS****
-// Same as Lab 3
- 
+  PutI = GetI = 0;   // Empty
+  OS_InitSemaphore(&CurrentSize, 0);
+  LostData = 0;
 }
 
 // ******** OS_FIFO_Put ************
@@ -289,10 +374,14 @@ void OS_FIFO_Init(void){
 // Inputs:  data to be stored
 // Outputs: 0 if successful, -1 if the FIFO is full
 int OS_FIFO_Put(uint32_t data){
-// ****IMPLEMENT THIS****
-// Same as Lab 3
-  
- return 0; // success
+  if(CurrentSize == FSIZE){
+    LostData++;
+    return -1;   // full
+  }
+  Fifo[PutI] = data;         // Put
+  PutI = (PutI+1)%FSIZE;
+  OS_Signal(&CurrentSize);
+  return 0; // success
 }
 
 // ******** OS_FIFO_Get ************
@@ -303,10 +392,10 @@ int OS_FIFO_Put(uint32_t data){
 // Inputs:  none
 // Outputs: data retrieved
 uint32_t OS_FIFO_Get(void){uint32_t data;
-// ****IMPLEMENT THIS****
-// Same as Lab 3
- return data;
-  
+  OS_Wait(&CurrentSize);     // block if empty
+  data = Fifo[GetI];         // get
+  GetI = (GetI+1)%FSIZE;
+  return data;
 }
 // *****periodic events****************
 int32_t *PeriodicSemaphore0;
@@ -365,23 +454,22 @@ int32_t *edgeSemaphore;
 // Outputs: none
 void OS_EdgeTrigger_Init(int32_t *semaPt, uint8_t priority){
   edgeSemaphore = semaPt;
-//***IMPLEMENT THIS***
-// 1) activate clock for Port D
-// allow time for clock to stabilize
-// 2) no need to unlock PD6
-// 3) disable analog on PD6
-// 4) configure PD6 as GPIO
-// 5) make PD6 input
-// 6) disable alt funct on PD6
-// disable pull-up on PD6
-// 7) enable digital I/O on PD6  
-// (d) PD6 is edge-sensitive 
-//     PD6 is not both edges 
-//     PD6 is falling edge event 
-// (e) clear PD6 flag
-// (f) arm interrupt on PD6
-// priority on Port D edge trigger is NVIC_PRI0_R	31  29
-// enable is bit 3 in NVIC_EN0_R
+  SYSCTL_RCGCGPIO_R |= 0x08;       // 1) activate clock for Port D
+  while((SYSCTL_PRGPIO_R&0x08) == 0){};// allow time for clock to stabilize
+                                   // 2) no need to unlock PD6
+  GPIO_PORTD_AMSEL_R &= ~0x40;     // 3) disable analog on PD6
+  GPIO_PORTD_PCTL_R &= ~0x0F000000;// 4) configure PD6 as GPIO
+  GPIO_PORTD_DIR_R &= ~0x40;       // 5) make PD6 input
+  GPIO_PORTD_AFSEL_R &= ~0x40;     // 6) disable alt funct on PD6
+  GPIO_PORTD_PUR_R &= ~0x40;       // disable pull-up on PD6
+  GPIO_PORTD_DEN_R |= 0x40;        // 7) enable digital I/O on PD6
+  GPIO_PORTD_IS_R &= ~0x40;        // (d) PD6 is edge-sensitive
+  GPIO_PORTD_IBE_R &= ~0x40;       //     PD6 is not both edges
+  GPIO_PORTD_IEV_R &= ~0x40;       //     PD6 is falling edge event
+  GPIO_PORTD_ICR_R = 0x40;         // (e) clear PD6 flag
+  GPIO_PORTD_IM_R |= 0x40;         // (f) arm interrupt on PD6
+  NVIC_PRI0_R = (NVIC_PRI0_R&0x00FFFFFF)|((uint32_t)priority<<29); // priority on Port D is bits 31-29
+  NVIC_EN0_R = 0x08;               // enable is bit 3 in NVIC_EN0_R
 }
 
 // ******** OS_EdgeTrigger_Restart ************
@@ -390,15 +478,13 @@ void OS_EdgeTrigger_Init(int32_t *semaPt, uint8_t priority){
 // Inputs:  none
 // Outputs: none
 void OS_EdgeTrigger_Restart(void){
-//***IMPLEMENT THIS***
-// rearm interrupt 3 in NVIC
-// clear flag6
+  GPIO_PORTD_IM_R |= 0x40;         // rearm interrupt 3 in NVIC
+  GPIO_PORTD_ICR_R = 0x40;         // clear flag6
 }
 void GPIOPortD_Handler(void){
-//***IMPLEMENT THIS***
-	// step 1 acknowledge by clearing flag
-  // step 2 signal semaphore (no need to run scheduler)
-  // step 3 disarm interrupt to prevent bouncing to create multiple signals
+  GPIO_PORTD_ICR_R = 0x40;         // step 1 acknowledge by clearing flag
+  OS_Signal(edgeSemaphore);        // step 2 signal semaphore (no need to run scheduler)
+  GPIO_PORTD_IM_R &= ~0x40;        // step 3 disarm interrupt to prevent bouncing to create multiple signals
 }
 
 
@@ -36,6 +36,9 @@
 #define HFAULTSTAT      (*((volatile uint32_t *)0xE000ED2C))
 #define MMADDR          (*((volatile uint32_t *)0xE000ED34))
 #define FAULTADDR       (*((volatile uint32_t *)0xE000ED38))
+#define DEMCR           (*((volatile uint32_t *)0xE000EDFC))
+#define DWT_CTRL        (*((volatile uint32_t *)0xE0001000))
+#define DWT_CYCCNT      (*((volatile uint32_t *)0xE0001004))
 
 // these functions are defined in the startup file
 
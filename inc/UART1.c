@@ -34,8 +34,11 @@
 #define FIFOSIZE   256       // size of the FIFOs (must be power of 2)
 #define FIFOSUCCESS 1        // return value on success
 #define FIFOFAIL    0        // return value on failure
-uint32_t RxPutI;      // should be 0 to SIZE-1
-uint32_t RxGetI;      // should be 0 to SIZE-1 
+// The handler is the only writer of RxPutI and the main program the
+// only writer of RxGetI, so no critical section is needed.  They are
+// volatile so UART1_InChar sees new data while it spins.
+volatile uint32_t RxPutI;      // should be 0 to SIZE-1
+volatile uint32_t RxGetI;      // should be 0 to SIZE-1 
 uint32_t RxFifoLost;  // should be 0 
 uint8_t RxFIFO[FIFOSIZE];
 void RxFifo_Init(void){